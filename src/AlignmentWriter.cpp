@@ -0,0 +1,134 @@
+#include "AlignmentWriter.h"
+
+#include <htslib/hts.h>
+
+#include "TwoBitFile.h"
+#include "util.h"
+
+
+/**
+ * @brief Write the amplicons as alignments to their reference in SAM, BAM or CRAM format.
+ *
+ * @details Every amplicon is stored at the position of its left primer with the CIGAR of the indels
+ *          that were injected into its lineage, s.t. it does not have to be aligned back to the reference.
+ *          Amplicons on the reverse strand are flagged (0x10) instead of being reverse complemented.
+ *          Besides NM and MD, the records carry the tags
+ *          - ap:i   the primer pair index (0-based, in the order of the primer file)
+ *          - lg:B:i the replicate indices from the original insert (0) to the amplicon
+ *          - ne:B:i the number of injected substitutions, insertions and deletions along the lineage
+ * @param output_file The name of the output file (NULL for standard output).
+ * @param format The output format ("sam", "bam" or "cram").
+ * @param ref_genomes The names of the reference files (a single FASTA file is used as CRAM reference).
+ * @param contigs The name and length of every contig.
+ * @param amplicons A vector of strings containing the amplicons (forward strand).
+ * @param vec_reps A vector of integers containing the number of replications for each amplicon template.
+ * @param alignments The true alignments of the amplicons (parallel to the amplicons).
+ * @param strand The strand mode ("forward", "reverse" or "random").
+ * @param seed The random seed.
+ * @param n_threads The number of compression threads.
+ * @return int 0 if the function was executed correctly, 1 otherwise.
+ */
+int write_alignments(const char                                         *output_file,
+                     const std::string                                  &format,
+                     const std::vector<std::string>                     &ref_genomes,
+                     const std::vector<std::pair<std::string, size_t>>  &contigs,
+                     const std::vector<std::string>                     &amplicons,
+                     const std::vector<int>                             &vec_reps,
+                     const std::vector<AmpliconAlignment>               &alignments,
+                     const std::string                                  &strand,
+                     const unsigned                                     seed,
+                     const int                                          n_threads){
+
+    if (alignments.size() != amplicons.size()){
+        std::cerr << "Error: the alignments do not match the amplicons." << std::endl;
+        return 1;
+    }
+
+    const char *mode = (format == "bam") ? "wb" : (format == "cram") ? "wc" : "w";
+    htsFile *fp = sam_open(output_file == NULL ? "-" : output_file, mode);
+    if (fp == NULL){
+        std::cerr << "Error opening the output file." << std::endl;
+        return 1;
+    }
+    if (n_threads > 1){
+        hts_set_threads(fp, n_threads);
+    }
+
+    // a single FASTA reference compresses the CRAM records against it, else the bases are stored as they are
+    if (format == "cram"){
+        if (ref_genomes.size() == 1 && !TwoBitFile::is_twobit(ref_genomes[0])){
+            hts_set_fai_filename(fp, ref_genomes[0].c_str());
+        } else {
+            hts_set_opt(fp, CRAM_OPT_NO_REF, 1);
+        }
+    }
+
+    // header with the contigs of the references
+    sam_hdr_t *header = sam_hdr_init();
+    int ret = sam_hdr_add_line(header, "HD", "VN", SAM_FORMAT_VERSION, "SO", "unsorted", NULL);
+    for (auto &contig : contigs){
+        std::string length = std::to_string(contig.second);
+        ret |= sam_hdr_add_line(header, "SQ", "SN", contig.first.c_str(), "LN", length.c_str(), NULL);
+    }
+    ret |= sam_hdr_add_line(header, "PG", "ID", "amplisim", "PN", "amplisim", "VN", VERSION, NULL);
+    if (ret != 0 || sam_hdr_write(fp, header) != 0){
+        std::cerr << "Error writing the alignment header." << std::endl;
+        sam_hdr_destroy(header);
+        sam_close(fp);
+        return 1;
+    }
+
+    const bool reverse = (strand != "forward");
+    const bool random = (strand == "random");
+
+    bam1_t *record = bam_init1();
+
+    // insert idx
+    int idx_insert = 0;
+    int count_per_insert = 1;
+
+    const int n_amplicons = amplicons.size();
+    for (int idx_amplicon = 0; idx_amplicon < n_amplicons && ret == 0; ++idx_amplicon){
+
+        const AmpliconAlignment &alignment = alignments[idx_amplicon];
+        const std::string &amplicon = amplicons[idx_amplicon];
+
+        std::string name = "amplicon_" + std::to_string(idx_insert) + "_" + std::to_string(idx_amplicon);
+        uint16_t flag = (reverse && is_reverse_strand(random, seed, idx_amplicon)) ? BAM_FREVERSE : 0;
+
+        int32_t injected[3] = {alignment.substitutions, alignment.insertions, alignment.deletions};
+
+        if (bam_set1(record, name.size(), name.c_str(), flag, alignment.tid, alignment.pos, 60,
+                     alignment.cigar.size(), alignment.cigar.data(), -1, -1, 0,
+                     amplicon.size(), amplicon.c_str(), NULL, 0) < 0
+            || bam_aux_update_int(record, "NM", alignment.nm) != 0
+            || bam_aux_append(record, "MD", 'Z', alignment.md.size() + 1, (const uint8_t *) alignment.md.c_str()) != 0
+            || bam_aux_update_int(record, "ap", alignment.primer) != 0
+            || bam_aux_update_array(record, "lg", 'i', alignment.lineage.size(), (void *) alignment.lineage.data()) != 0
+            || bam_aux_update_array(record, "ne", 'i', 3, injected) != 0
+            || sam_write1(fp, header, record) < 0){
+            ret = 1;
+        }
+
+        // check if the current amplicon is the last one of the current insert
+        if (count_per_insert == vec_reps[idx_insert]){
+            count_per_insert = 1;
+            idx_insert++;
+        } else {
+            count_per_insert++;
+        }
+    }
+
+    bam_destroy1(record);
+    sam_hdr_destroy(header);
+    if (sam_close(fp) < 0){
+        ret = 1;
+    }
+
+    if (ret != 0){
+        std::cerr << "Error writing the alignments." << std::endl;
+        return 1;
+    }
+
+    return 0;
+}
@@ -0,0 +1,26 @@
+#ifndef ALIGNMENT_WRITER_H
+#define ALIGNMENT_WRITER_H
+
+#include <string>
+#include <vector>
+#include <iostream>
+#include <htslib/sam.h>
+
+#include "AmpliconGenerator.h"
+
+
+int write_alignments(const char                                         *output_file,
+                     const std::string                                  &format,
+                     const std::vector<std::string>                     &ref_genomes,
+                     const std::vector<std::pair<std::string, size_t>>  &contigs,
+                     const std::vector<std::string>                     &amplicons,
+                     const std::vector<int>                             &vec_reps,
+                     const std::vector<AmpliconAlignment>               &alignments,
+                     const std::string                                  &strand,
+                     const unsigned                                     seed,
+                     const int                                          n_threads = 1);
+
+
+
+
+#endif // ALIGNMENT_WRITER_H
@@ -1,124 +1,362 @@
 #include "AmpliconGenerator.h"
 
+#include <cctype>
+#include <climits>
+#include <algorithm>
+
 
 /**
  * @brief Construct a new AmpliconGenerator::AmpliconGenerator object
  * 
  * @param primers A vector of Primer objects.
- * @param chromosomes An unordered map of chromosome names (key) and sequences (value).
  * @param primer_index A PrimerIndex object.
+ * @param error_profile The error profile of the replications.
+ * @param rng The source of random numbers.
  */
-AmpliconGenerator::AmpliconGenerator(std::vector<Primer> &primers, std::unordered_map<std::string, std::string> &chromosomes, PrimerIndex &primer_index){
+AmpliconGenerator::AmpliconGenerator(std::vector<Primer> &primers, PrimerIndex &primer_index, const ErrorProfile &error_profile, RandomSource &rng){
     this->primers = &primers;
-    this->chromosomes = &chromosomes;
     this->primer_index = &primer_index;
+    this->error_profile = &error_profile;
+    this->rng = &rng;
 }
 
 
 /**
- * @brief Generate amplicons from a set of primers.
+ * @brief Generate amplicons from the set of primers of a single chromosome.
  * 
+ * @param chr The name of the chromosome.
+ * @param sequence The sequence of the chromosome.
  * @param amplicons A vector of strings to store the amplicons.
- * @param verbose A boolean to print messages to the user.
+ * @param arguments The command line arguments.
  * @return int 0 if the function was executed correctly, 1 otherwise.
  */
-int AmpliconGenerator::generate_amplicons(std::vector<std::string> &amplicons, arguments &arguments){
+int AmpliconGenerator::generate_amplicons(const std::string &chr, const std::string &sequence, std::vector<std::string> &amplicons, arguments &arguments){
+    return this->dispatch(chr, sequence, 0, INT_MAX, amplicons, arguments);
+}
 
-    assert(amplicons.empty());
 
-    // print a message to the user
-    if (arguments.verbose){
-        std::cout << "Generating amplicons..." << std::endl;
+/**
+ * @brief Generate amplicons from the set of primers of a single chromosome of a .2bit file.
+ * 
+ * @details Only the primer and insert spans are decoded, the chromosome is never unpacked as a whole.
+ * @param chr The name of the chromosome.
+ * @param sequence The memory mapped sequence of the chromosome.
+ * @param amplicons A vector of strings to store the amplicons.
+ * @param arguments The command line arguments.
+ * @return int 0 if the function was executed correctly, 1 otherwise.
+ */
+int AmpliconGenerator::generate_amplicons(const std::string &chr, const TwoBitSequence &sequence, std::vector<std::string> &amplicons, arguments &arguments){
+    return this->dispatch(chr, sequence, 0, INT_MAX, amplicons, arguments);
+}
+
+
+/**
+ * @brief Generate amplicons from a range of the primers of a single chromosome.
+ * 
+ * @details The random numbers are drawn in the same order as by a single call for the whole chromosome,
+ *          i.e. consecutive ranges generate the same amplicons as the whole chromosome at once.
+ * @param chr The name of the chromosome.
+ * @param sequence The sequence of the chromosome.
+ * @param first The index of the first primer pair of the range.
+ * @param last The index past the last primer pair of the range (both are clipped to the primers of the chromosome).
+ * @param amplicons A vector of strings to store the amplicons.
+ * @param arguments The command line arguments.
+ * @return int 0 if the function was executed correctly, 1 otherwise.
+ */
+int AmpliconGenerator::generate_range(const std::string &chr, const std::string &sequence, int first, int last, std::vector<std::string> &amplicons, arguments &arguments){
+    return this->dispatch(chr, sequence, first, last, amplicons, arguments);
+}
+
+
+/**
+ * @brief Generate amplicons from a range of the primers of a single chromosome of a .2bit file.
+ * 
+ * @param chr The name of the chromosome.
+ * @param sequence The memory mapped sequence of the chromosome.
+ * @param first The index of the first primer pair of the range.
+ * @param last The index past the last primer pair of the range (both are clipped to the primers of the chromosome).
+ * @param amplicons A vector of strings to store the amplicons.
+ * @param arguments The command line arguments.
+ * @return int 0 if the function was executed correctly, 1 otherwise.
+ */
+int AmpliconGenerator::generate_range(const std::string &chr, const TwoBitSequence &sequence, int first, int last, std::vector<std::string> &amplicons, arguments &arguments){
+    return this->dispatch(chr, sequence, first, last, amplicons, arguments);
+}
+
+
+/**
+ * @brief Dispatch to the generator that is specialized on the error model of the profile.
+ * 
+ * @tparam Sequence The type of the sequence (std::string or TwoBitSequence).
+ * @param chr The name of the chromosome.
+ * @param sequence The sequence of the chromosome.
+ * @param first The index of the first primer pair.
+ * @param last The index past the last primer pair.
+ * @param amplicons A vector of strings to store the amplicons.
+ * @param arguments The command line arguments.
+ * @return int 0 if the function was executed correctly, 1 otherwise.
+ */
+template <class Sequence>
+int AmpliconGenerator::dispatch(const std::string &chr, const Sequence &sequence, int first, int last, std::vector<std::string> &amplicons, arguments &arguments){
+
+    switch (this->error_profile->kind()){
+        case ErrorProfile::SUBSTITUTION:
+            return this->generate_amplicons<SubstitutionModel>(chr, sequence, first, last, amplicons, arguments);
+        case ErrorProfile::UNIFORM_INDEL:
+            return this->generate_amplicons<UniformIndelModel>(chr, sequence, first, last, amplicons, arguments);
+        case ErrorProfile::CONTEXT:
+            return this->generate_amplicons<ContextModel>(chr, sequence, first, last, amplicons, arguments);
     }
 
-    // iterate over the chromoseomes
-    for(auto &chromosome : *this->chromosomes){
+    return 1;
+}
 
-        // for the chromosome name give me the index from the primer index
-        int index = this->primer_index->get_index(chromosome.first);
 
-        // continue if the index is -1 (the chromosome name is not in the primer index)
-        if (index == -1){
-            continue;
-        }
+/**
+ * @brief Generate amplicons from the set of primers of a single chromosome with a given error model.
+ * 
+ * @details The function is called once per chromosome, s.t. the amplicons of a chromosome
+ *          can be generated as soon as its sequence is loaded.
+ * @tparam ErrorModel The error model of the replications.
+ * @tparam Sequence The type of the sequence (std::string or TwoBitSequence).
+ * @param chr The name of the chromosome.
+ * @param sequence The sequence of the chromosome.
+ * @param first The index of the first primer pair.
+ * @param last The index past the last primer pair.
+ * @param amplicons A vector of strings to store the amplicons.
+ * @param arguments The command line arguments.
+ * @return int 0 if the function was executed correctly, 1 otherwise.
+ */
+template <class ErrorModel, class Sequence>
+int AmpliconGenerator::generate_amplicons(const std::string &chr, const Sequence &sequence, int first, int last, std::vector<std::string> &amplicons, arguments &arguments){
+
+    // the error model tables are precomputed once per chromosome
+    Replicator<ErrorModel> replicator(ErrorModel(*this->error_profile), *this->rng);
+
+    // a chromosome generated in consecutive ranges is recorded once
+    if (first == 0 || this->contigs.empty() || this->contigs.back().first != chr){
+        this->contigs.push_back(std::make_pair(chr, (size_t) sequence.length()));
+    }
 
-        // for the chromosome name give me the runlength from the primer index
-        int runlength = this->primer_index->get_runlength(chromosome.first);
+    // for the chromosome name give me the index from the primer index
+    int index = this->primer_index->get_index(chr);
+
+    // return if the index is -1 (the chromosome name is not in the primer index)
+    if (index == -1){
+        return 0;
+    }
+
+    // print a message to the user
+    if (arguments.verbose){
+        std::cout << "Generating amplicons for " << chr << "..." << std::endl;
+    }
+
+    // for the chromosome name give me the runlength from the primer index
+    int runlength = this->primer_index->get_runlength(chr);
 
 #ifdef DEBUG
-        assert(runlength > 0);
+    assert(runlength > 0);
 #endif
 
-        // iterate over the vector of primers from the index to the index plus the runlength
-        for (int i = index; i < index + runlength; i++){
+    // iterate over the vector of primers from the index to the index plus the runlength (within the range)
+    for (int i = std::max(index, first); i < std::min(index + runlength, last); i++){
 
-            // amplicon dropout chance here
-            double p_dropout = (double) rand() / RAND_MAX; // [0,1]
-            if (p_dropout < arguments.dropout){
-                if (arguments.verbose) std::cout << "Amplicon primer pair skipped." << std::endl;
-                continue;
-            }
+        // amplicon dropout chance here
+        double p_dropout = (double) this->rng->next() / RAND_MAX; // [0,1]
+        if (p_dropout < arguments.dropout){
+            if (arguments.verbose) std::cout << "Amplicon primer pair skipped." << std::endl;
+            continue;
+        }
 
-            // get the start and end position of the left primer
-            int left_start = this->primers->at(i).start_left;
-            int left_end = this->primers->at(i).end_left;
+        // get the start and end position of the left primer
+        int left_start = this->primers->at(i).start_left;
+        int left_end = this->primers->at(i).end_left;
 
 #ifdef DEBUG
-            assert(left_start < left_end);
-            assert(left_end < this->chromosomes->at(chromosome.first).length());
-            assert(left_start > 0);
+        assert(left_start < left_end);
+        assert(left_end < sequence.length());
+        assert(left_start > 0);
 #endif
 
-            // get the sequence of the left primer
-            std::string left_primer = this->chromosomes->at(chromosome.first).substr(left_start, left_end - left_start);
+        // get the sequence of the left primer
+        std::string left_primer = sequence.substr(left_start, left_end - left_start);
 
-            // get the start and end position of the right primer
-            int right_start = this->primers->at(i).start_right;
-            int right_end = this->primers->at(i).end_right;
+        // get the start and end position of the right primer
+        int right_start = this->primers->at(i).start_right;
+        int right_end = this->primers->at(i).end_right;
 
 #ifdef DEBUG
-            assert(right_start < right_end);
-            assert(right_end < this->chromosomes->at(chromosome.first).length());
-            assert(right_start > 0);
+        assert(right_start < right_end);
+        assert(right_end < sequence.length());
+        assert(right_start > 0);
 #endif
 
-            // get the sequence of the right primer
-            std::string right_primer = this->chromosomes->at(chromosome.first).substr(right_start, right_end - right_start);
-
-            // get the insert sequence of the amplicon
-            // which is from the end of the left primer to the start of the right primer
-            std::string insert = this->chromosomes->at(chromosome.first).substr(left_end, right_start - left_end);
-
-            // create the amplicon
-            // generate insert sequences with errors
-            Replicator replicator(0.01);
-            std::vector<std::string> replicates;
-            int reps;
-            int ret = replicator.replicate_with_errors(insert, replicates, arguments.mean, arguments.sd, reps);
-            if (ret != 0){
-                std::cerr << "Error replicating the insert sequence." << std::endl;
-                return 1;
-            }
+        // get the sequence of the right primer
+        std::string right_primer = sequence.substr(right_start, right_end - right_start);
 
-            this->vec_reps.push_back(reps);
+        // get the insert sequence of the amplicon
+        // which is from the end of the left primer to the start of the right primer
+        std::string insert = sequence.substr(left_end, right_start - left_end);
 
-            // generate amplification products from the replicates
-            for (auto &replicate : replicates){
-                std::string amplicon = left_primer + replicate + right_primer;
+        // create the amplicon
+        // generate insert sequences with errors
+        std::vector<std::string> replicates;
+        std::vector<ReplicateTruth> truths;
+        int reps;
+        int ret;
+        if (this->alignments == NULL){
+            ret = replicator.replicate_with_errors(insert, replicates, arguments.mean, arguments.sd, reps);
+        } else {
+            ret = replicator.replicate_with_errors(insert, replicates, arguments.mean, arguments.sd, reps, truths);
+        }
+        if (ret != 0){
+            std::cerr << "Error replicating the insert sequence." << std::endl;
+            return 1;
+        }
+
+        this->vec_reps.push_back(reps);
+        this->vec_primers.push_back(i);
+
+        // generate amplification products from the replicates
+        const std::string reference = (this->alignments == NULL) ? std::string() : left_primer + insert + right_primer;
+        for (size_t r = 0; r < replicates.size(); r++){
+            std::string amplicon = left_primer + replicates[r] + right_primer;
+            if (this->alignments != NULL){
+                AmpliconAlignment alignment;
+                alignment.tid = this->contigs.size() - 1;
+                alignment.pos = left_start;
+                alignment.primer = i;
+                this->align_replicate(reference, left_end - left_start, right_end - right_start, amplicon, truths, r, alignment);
+                this->alignments->push_back(std::move(alignment));
+            }
+            if (this->sink != NULL){
+                if (this->sink->add(this->vec_reps.size() - 1, amplicon) != 0){
+                    return 1;
+                }
+            } else {
                 amplicons.push_back(amplicon);
             }
+        }
+
+    }
+
+    return 0;
+}
+
+
+/**
+ * @brief Derive the true alignment of an amplicon from the ground truth of its replicate.
+ * 
+ * @param reference The reference span of the amplicon (left primer, insert and right primer).
+ * @param left_length The length of the left primer.
+ * @param right_length The length of the right primer.
+ * @param amplicon The amplicon (left primer, replicate and right primer).
+ * @param truths The ground truth of the replicates of the insert.
+ * @param replicate The index of the replicate.
+ * @param alignment An AmpliconAlignment object to store the CIGAR, MD, NM and the lineage.
+ */
+void AmpliconGenerator::align_replicate(const std::string &reference, int left_length, int right_length, const std::string &amplicon, const std::vector<ReplicateTruth> &truths, int replicate, AmpliconAlignment &alignment){
+
+    const ReplicateTruth &truth = truths[replicate];
+    const int amplicon_length = amplicon.size();
+    const int insert_length = reference.size() - left_length - right_length;
+
+    alignment.cigar.clear();
+    alignment.md.clear();
+    alignment.nm = 0;
+
+    auto add_operation = [&](uint32_t operation, uint32_t length){
+        if (!alignment.cigar.empty() && (alignment.cigar.back() & 0xF) == operation){
+            alignment.cigar.back() += length << 4;
+        } else {
+            alignment.cigar.push_back(length << 4 | operation);
+        }
+    };
+
+    int last = -1;      // reference position of the last aligned base
+    int n_matches = 0;  // matching bases since the last MD entry
+    for (int q = 0; q < amplicon_length; q++){
+
+        // reference position of the amplicon base, the primers are never replicated with errors
+        int origin;
+        if (q < left_length){
+            origin = q;
+        } else if (q >= amplicon_length - right_length){
+            origin = left_length + insert_length + (q - (amplicon_length - right_length));
+        } else {
+            origin = truth.origin[q - left_length];
+            origin = (origin < 0) ? -1 : left_length + origin;
+        }
+
+        if (origin < 0){
+            add_operation(AmpliconAlignment::INSERTION, 1);
+            alignment.nm++;
+            continue;
+        }
 
+        if (origin > last + 1){
+            add_operation(AmpliconAlignment::DELETION, origin - last - 1);
+            alignment.nm += origin - last - 1;
+            alignment.md += std::to_string(n_matches) + "^";
+            for (int r = last + 1; r < origin; r++){
+                alignment.md += (char) toupper(reference[r]);
+            }
+            n_matches = 0;
         }
 
+        add_operation(AmpliconAlignment::MATCH, 1);
+        if (toupper(amplicon[q]) == toupper(reference[origin])){
+            n_matches++;
+        } else {
+            alignment.nm++;
+            alignment.md += std::to_string(n_matches);
+            alignment.md += (char) toupper(reference[origin]);
+            n_matches = 0;
+        }
+        last = origin;
     }
+    alignment.md += std::to_string(n_matches);
 
-    // print a warning if the vector of amplicons is empty and return 1
-    if (amplicons.empty()){
-        std::cout << "WARNING: No amplicons were generated." << std::endl;
-        return 1;
+    // the lineage from the original insert to the replicate
+    alignment.lineage.clear();
+    for (int r = replicate; r >= 0; r = truths[r].parent){
+        alignment.lineage.push_back(r);
     }
+    std::reverse(alignment.lineage.begin(), alignment.lineage.end());
 
-    return 0;
+    alignment.substitutions = truth.substitutions;
+    alignment.insertions = truth.insertions;
+    alignment.deletions = truth.deletions;
+}
+
+
+/**
+ * @brief Record the true alignment of every generated amplicon.
+ * 
+ * @param alignments A vector to store the alignments (parallel to the amplicons).
+ */
+void AmpliconGenerator::record_alignments(std::vector<AmpliconAlignment> &alignments){
+    this->alignments = &alignments;
+}
+
+
+/**
+ * @brief Pass every generated amplicon to a sink instead of storing it in the vector of amplicons.
+ * 
+ * @param sink The AmpliconSink object.
+ */
+void AmpliconGenerator::stream_to(AmpliconSink &sink){
+    this->sink = &sink;
+}
+
+
+/**
+ * @brief Get the name and length of every contig passed to the generator.
+ * 
+ * @return const std::vector<std::pair<std::string, size_t>>& The contigs in the order they were passed.
+ */
+const std::vector<std::pair<std::string, size_t>> &AmpliconGenerator::get_contigs(){
+    return this->contigs;
 }
 
 
@@ -131,3 +369,12 @@ std::vector<int> AmpliconGenerator::get_vec_reps(){
     return this->vec_reps;
 }
 
+
+/**
+ * @brief Get the primer pair index of every generated amplicon template.
+ * 
+ * @return std::vector<int> A vector of integers (indices into the vector of primers).
+ */
+std::vector<int> AmpliconGenerator::get_vec_primers(){
+    return this->vec_primers;
+}
@@ -5,14 +5,48 @@
 #include <vector>
 #include <unordered_map>
 #include <cassert>
+#include <cstdint>
 
 #include "argparser.h"
 #include "Primer.h"
 #include "PrimerIndex.h"
 #include "Replicator.h"
+#include "ErrorProfile.h"
+#include "RandomSource.h"
+#include "TwoBitFile.h"
 
 
 
+/**
+ * @brief The true alignment of an amplicon to its reference.
+ * 
+ */
+struct AmpliconAlignment{
+    enum {MATCH = 0, INSERTION = 1, DELETION = 2};  // CIGAR operations in the BAM encoding
+    int tid;                        // index of the contig
+    int pos;                        // 0-based start position of the left primer
+    int primer;                     // primer pair index
+    std::vector<uint32_t> cigar;    // length << 4 | operation
+    std::string md;
+    int nm;
+    std::vector<int> lineage;       // replicate indices from the original insert (0) to the amplicon
+    int substitutions;              // errors injected along the lineage
+    int insertions;
+    int deletions;
+};
+
+
+/**
+ * @brief An interface to consume the amplicons while they are generated instead of collecting them.
+ * 
+ */
+class AmpliconSink{
+    public:
+        virtual ~AmpliconSink() {}
+        virtual int add(int template_index, std::string &amplicon) = 0;
+};
+
+
 /**
  * @brief Class to generate amplicons from a set of primers.
  * 
@@ -20,13 +54,30 @@
 class AmpliconGenerator{
     private:
         std::vector<int> vec_reps;  // RAII (Resource Acquisition Is Initialization)
+        std::vector<int> vec_primers;   // primer pair index of every generated amplicon template
         std::vector<Primer> *primers;
-        std::unordered_map<std::string, std::string> *chromosomes;
         PrimerIndex *primer_index;
+        const ErrorProfile *error_profile;
+        RandomSource *rng;
+        std::vector<std::pair<std::string, size_t>> contigs;     // name and length of every contig seen
+        std::vector<AmpliconAlignment> *alignments = NULL;
+        AmpliconSink *sink = NULL;
+        void align_replicate(const std::string &reference, int left_length, int right_length, const std::string &amplicon, const std::vector<ReplicateTruth> &truths, int replicate, AmpliconAlignment &alignment);
+        template <class Sequence>
+        int dispatch(const std::string &chr, const Sequence &sequence, int first, int last, std::vector<std::string> &amplicons, arguments &arguments);
+        template <class ErrorModel, class Sequence>
+        int generate_amplicons(const std::string &chr, const Sequence &sequence, int first, int last, std::vector<std::string> &amplicons, arguments &arguments);
     public:
-        AmpliconGenerator(std::vector<Primer> &primers, std::unordered_map<std::string, std::string> &chromosomes, PrimerIndex &primer_index);
-        int generate_amplicons(std::vector<std::string> &amplicons, arguments &arguments);
+        AmpliconGenerator(std::vector<Primer> &primers, PrimerIndex &primer_index, const ErrorProfile &error_profile, RandomSource &rng);
+        int generate_amplicons(const std::string &chr, const std::string &sequence, std::vector<std::string> &amplicons, arguments &arguments);
+        int generate_amplicons(const std::string &chr, const TwoBitSequence &sequence, std::vector<std::string> &amplicons, arguments &arguments);
+        int generate_range(const std::string &chr, const std::string &sequence, int first, int last, std::vector<std::string> &amplicons, arguments &arguments);
+        int generate_range(const std::string &chr, const TwoBitSequence &sequence, int first, int last, std::vector<std::string> &amplicons, arguments &arguments);
+        void record_alignments(std::vector<AmpliconAlignment> &alignments);
+        void stream_to(AmpliconSink &sink);
+        const std::vector<std::pair<std::string, size_t>> &get_contigs();
         std::vector<int> get_vec_reps();
+        std::vector<int> get_vec_primers();
 };
 
 
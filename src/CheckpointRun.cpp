@@ -0,0 +1,391 @@
+#include "CheckpointRun.h"
+
+#include <sstream>
+#include <fstream>
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include "util.h"
+
+
+/**
+ * @brief Write a buffer to a file descriptor, retrying partial and interrupted writes.
+ *
+ * @return int 0 if the buffer was written completely, 1 otherwise.
+ */
+static int write_fully(int fd, const std::string &data){
+
+    size_t written = 0;
+    while (written < data.size()){
+        ssize_t n = write(fd, data.data() + written, data.size() - written);
+        if (n < 0){
+            if (errno == EINTR){
+                continue;
+            }
+            return 1;
+        }
+        written += n;
+    }
+
+    return 0;
+}
+
+
+/**
+ * @brief Construct a new CheckpointRun object.
+ *
+ * @param arguments The command line arguments (the seed must be set).
+ * @param error_profile The error profile of the replications.
+ * @param primers A vector of Primer objects.
+ * @param primer_index A PrimerIndex object.
+ */
+CheckpointRun::CheckpointRun(arguments &arguments, const ErrorProfile &error_profile, std::vector<Primer> &primers, PrimerIndex &primer_index) : rng((unsigned) arguments.seed){
+    this->args = &arguments;
+    this->generator_args = arguments;
+    this->generator_args.verbose = false;
+    this->primer_index = &primer_index;
+    this->ref_genomes.assign(arguments.args.begin(), arguments.args.end() - 1);
+    this->bed_file = arguments.args.back();
+    this->manifest_file = std::string(arguments.output_file) + ".checkpoint";
+    this->generator.reset(new AmpliconGenerator(primers, primer_index, error_profile, this->rng));
+    this->generator->stream_to(*this);
+}
+
+
+/**
+ * @brief Destroy the CheckpointRun object, the output written up to the last checkpoint is kept.
+ */
+CheckpointRun::~CheckpointRun(){
+    if (this->fd >= 0){
+        close(this->fd);
+    }
+}
+
+
+/**
+ * @brief Get the parameters of the simulation that determine its output, as recorded in the manifest.
+ *
+ * @return std::string Key value lines.
+ */
+std::string CheckpointRun::parameters(){
+
+    std::ostringstream oss;
+    oss << "# amplisim checkpoint\n";
+    oss << "version " << VERSION << '\n';
+    oss << "references";
+    for (auto &ref_genome : this->ref_genomes){
+        oss << ' ' << ref_genome;
+    }
+    oss << '\n';
+    oss << "primers " << this->bed_file << '\n';
+    oss << "seed " << this->args->seed << '\n';
+    oss << "mean " << this->args->mean << '\n';
+    oss << "sd " << this->args->sd << '\n';
+    oss << "dropout " << this->args->dropout << '\n';
+    oss << "error_rate " << this->args->error_rate << '\n';
+    oss << "profile " << (this->args->profile_file != NULL ? this->args->profile_file : "-") << '\n';
+    oss << "strand " << this->args->strand << '\n';
+
+    return oss.str();
+}
+
+
+/**
+ * @brief Read the manifest of an interrupted simulation.
+ *
+ * @return int 0 if the manifest is valid and matches the parameters, 1 otherwise.
+ */
+int CheckpointRun::read_manifest(){
+
+    std::ifstream in(this->manifest_file);
+    if (!in.is_open()){
+        std::cerr << "Error opening the checkpoint manifest \'" << this->manifest_file << "\'." << std::endl;
+        return 1;
+    }
+    std::stringstream content;
+    content << in.rdbuf();
+    std::string manifest = content.str();
+
+    const std::string parameters = this->parameters();
+    if (manifest.compare(0, parameters.size(), parameters) != 0){
+        std::cerr << "Error: the checkpoint manifest \'" << this->manifest_file << "\' was written with other parameters." << std::endl;
+        return 1;
+    }
+
+    std::istringstream iss(manifest.substr(parameters.size()));
+    std::string line;
+    int n_keys = 0;
+    bool ok = true;
+    while (ok && std::getline(iss, line)){
+        std::istringstream ss(line);
+        std::string key;
+        if (!(ss >> key)){
+            continue;
+        }
+        n_keys++;
+        if (key == "contig"){
+            ok = (bool) (ss >> this->resume_contig);
+        } else if (key == "primer"){
+            ok = (bool) (ss >> this->resume_primer);
+        } else if (key == "templates"){
+            ok = (bool) (ss >> this->n_templates);
+        } else if (key == "products"){
+            ok = (bool) (ss >> this->n_products);
+        } else if (key == "output_bytes"){
+            ok = (bool) (ss >> this->output_bytes);
+        } else if (key == "rng"){
+            std::string state;
+            std::getline(ss, state);
+            ok = (this->rng.set_state(state) == 0);
+        } else if (key == "finished"){
+            ok = (bool) (ss >> this->finished);
+        } else {
+            ok = false;
+        }
+    }
+    if (!ok || n_keys != 7){
+        std::cerr << "Error: the checkpoint manifest \'" << this->manifest_file << "\' is corrupt." << std::endl;
+        return 1;
+    }
+
+    return 0;
+}
+
+
+/**
+ * @brief Open the output, either to start a new simulation or to resume the simulation of the manifest.
+ *
+ * @details Without a manifest a resumed simulation starts from the beginning.
+ * @param resume A boolean to resume from the manifest.
+ * @return int 0 if the function was executed correctly, 1 otherwise.
+ */
+int CheckpointRun::open(bool resume){
+
+    const char *output_file = this->args->output_file;
+
+    if (resume && access(this->manifest_file.c_str(), F_OK) == 0){
+
+        if (this->read_manifest() != 0){
+            return 1;
+        }
+        if (this->finished){
+            return 0;
+        }
+
+        // drop the output written after the last checkpoint
+        struct stat st;
+        if (stat(output_file, &st) != 0 || (uint64_t) st.st_size < this->output_bytes || truncate(output_file, this->output_bytes) != 0){
+            std::cerr << "Error: the output file \'" << output_file << "\' is shorter than recorded in the checkpoint manifest." << std::endl;
+            return 1;
+        }
+        this->fd = ::open(output_file, O_WRONLY | O_APPEND);
+        if (this->fd < 0){
+            std::cerr << "Error opening the output file \'" << output_file << "\'." << std::endl;
+            return 1;
+        }
+
+        if (this->args->verbose){
+            std::cout << "Resuming after " << this->n_products << " amplicons (contig " << this->resume_contig << ", primer pair " << this->resume_primer << ")..." << std::endl;
+        }
+        return 0;
+    }
+
+    if (resume && this->args->verbose){
+        std::cout << "No checkpoint manifest found, starting from the beginning..." << std::endl;
+    }
+
+    this->fd = ::open(output_file, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (this->fd < 0){
+        std::cerr << "Error opening the output file \'" << output_file << "\'." << std::endl;
+        return 1;
+    }
+
+    // a simulation interrupted before its first checkpoint is resumed from the beginning
+    return this->checkpoint(0, 0, false);
+}
+
+
+/**
+ * @brief Write the records of the current chunk, sync the output and replace the manifest.
+ *
+ * @details The manifest is written to a temporary file and renamed, s.t. it always describes synced output.
+ * @param next_contig The ordinal of the contig of the first unfinished primer pair.
+ * @param next_primer The index of the first unfinished primer pair.
+ * @param finished A boolean to mark the simulation as finished.
+ * @return int 0 if the function was executed correctly, 1 otherwise.
+ */
+int CheckpointRun::checkpoint(long next_contig, int next_primer, bool finished){
+
+    if (write_fully(this->fd, this->buffer) != 0 || fsync(this->fd) != 0){
+        std::cerr << "Error writing the output file \'" << this->args->output_file << "\'." << std::endl;
+        return 1;
+    }
+    this->output_bytes += this->buffer.size();
+    this->buffer.clear();
+    this->pending = 0;
+
+    std::ostringstream manifest;
+    manifest << this->parameters();
+    manifest << "contig " << next_contig << '\n';
+    manifest << "primer " << next_primer << '\n';
+    manifest << "templates " << this->n_templates << '\n';
+    manifest << "products " << this->n_products << '\n';
+    manifest << "output_bytes " << this->output_bytes << '\n';
+    manifest << "rng " << this->rng.get_state() << '\n';
+    manifest << "finished " << (finished ? 1 : 0) << '\n';
+
+    const std::string temp_file = this->manifest_file + ".tmp";
+    int manifest_fd = ::open(temp_file.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    bool ok = (manifest_fd >= 0);
+    ok = ok && write_fully(manifest_fd, manifest.str()) == 0 && fsync(manifest_fd) == 0;
+    if (manifest_fd >= 0){
+        ok = (close(manifest_fd) == 0) && ok;
+    }
+    ok = ok && rename(temp_file.c_str(), this->manifest_file.c_str()) == 0;
+    if (!ok){
+        std::cerr << "Error writing the checkpoint manifest \'" << this->manifest_file << "\'." << std::endl;
+        return 1;
+    }
+
+    return 0;
+}
+
+
+/**
+ * @brief Generate the unfinished amplicons of a single chromosome, with a checkpoint after every chunk.
+ *
+ * @param chr The name of the chromosome.
+ * @param sequence The sequence of the chromosome.
+ * @return int 0 if the function was executed correctly, 1 otherwise.
+ */
+int CheckpointRun::generate(const std::string &chr, const std::string &sequence){
+    return this->generate_contig(chr, sequence);
+}
+
+
+/**
+ * @brief Generate the unfinished amplicons of a single chromosome of a .2bit file, with a checkpoint after every chunk.
+ *
+ * @param chr The name of the chromosome.
+ * @param sequence The memory mapped sequence of the chromosome.
+ * @return int 0 if the function was executed correctly, 1 otherwise.
+ */
+int CheckpointRun::generate(const std::string &chr, const TwoBitSequence &sequence){
+    return this->generate_contig(chr, sequence);
+}
+
+
+/**
+ * @brief Generate the unfinished amplicons of a single chromosome.
+ *
+ * @details The contigs are identified by their ordinal in the references, the finished contigs are skipped.
+ * @tparam Sequence The type of the sequence (std::string or TwoBitSequence).
+ * @param chr The name of the chromosome.
+ * @param sequence The sequence of the chromosome.
+ * @return int 0 if the function was executed correctly, 1 otherwise.
+ */
+template <class Sequence>
+int CheckpointRun::generate_contig(const std::string &chr, const Sequence &sequence){
+
+    const long ordinal = this->contig++;
+    if (ordinal < this->resume_contig){
+        return 0;
+    }
+
+    int index = this->primer_index->get_index(chr);
+    if (index == -1){
+        return 0;
+    }
+    const int end = index + this->primer_index->get_runlength(chr);
+    int first = (ordinal == this->resume_contig) ? std::max(index, this->resume_primer) : index;
+
+    if (this->args->verbose && first < end){
+        std::cout << "Generating amplicons for " << chr << "..." << std::endl;
+    }
+
+    std::vector<std::string> amplicons;     // unused, the amplicons are streamed to the output
+    while (first < end){
+        int last = std::min(end, first + (this->args->checkpoint - this->pending));
+        if (this->generator->generate_range(chr, sequence, first, last, amplicons, this->generator_args) != 0){
+            return 1;
+        }
+        this->pending += last - first;
+        first = last;
+        if (this->pending >= this->args->checkpoint && this->checkpoint(ordinal, first, false) != 0){
+            return 1;
+        }
+    }
+
+    return 0;
+}
+
+
+/**
+ * @brief Orient an amplicon and append its FASTA record to the current chunk.
+ *
+ * @param template_index The index of the amplicon template within the generator of this process.
+ * @param amplicon The amplicon (forward strand, reverse complemented in place if needed).
+ * @return int 0 if the function was executed correctly, 1 otherwise.
+ */
+int CheckpointRun::add(int template_index, std::string &amplicon){
+
+    // the generator of a resumed simulation counts its templates from 0
+    if (template_index != this->last_template){
+        this->last_template = template_index;
+        this->n_templates++;
+    }
+
+    const std::string strand = this->args->strand;
+    if (strand != "forward" && is_reverse_strand(strand == "random", (unsigned) this->args->seed, this->n_products)){
+        reverse_complement(amplicon);
+    }
+
+    this->buffer += ">amplicon_";
+    this->buffer += std::to_string(this->n_templates - 1);
+    this->buffer += '_';
+    this->buffer += std::to_string(this->n_products);
+    this->buffer += '\n';
+    this->buffer += amplicon;
+    this->buffer += '\n';
+    this->n_products++;
+
+    return 0;
+}
+
+
+/**
+ * @brief Write the last chunk and mark the simulation as finished.
+ *
+ * @return int 0 if the function was executed correctly, 1 otherwise.
+ */
+int CheckpointRun::finish(){
+
+    int ret = this->checkpoint(this->contig, 0, true);
+    if (close(this->fd) != 0){
+        ret = 1;
+    }
+    this->fd = -1;
+    this->finished = true;
+
+    return ret;
+}
+
+
+/**
+ * @brief Check if the manifest marks the simulation as finished, i.e. there is nothing to resume.
+ */
+bool CheckpointRun::is_finished() const{
+    return this->finished;
+}
+
+
+/**
+ * @brief Get the number of amplicons written (including those of the resumed checkpoint).
+ */
+long CheckpointRun::size() const{
+    return this->n_products;
+}
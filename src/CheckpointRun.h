@@ -0,0 +1,76 @@
+#ifndef CHECKPOINT_RUN_H
+#define CHECKPOINT_RUN_H
+
+#include <string>
+#include <vector>
+#include <memory>
+#include <iostream>
+#include <cstdint>
+
+#include "argparser.h"
+#include "Primer.h"
+#include "PrimerIndex.h"
+#include "ErrorProfile.h"
+#include "RandomSource.h"
+#include "AmpliconGenerator.h"
+#include "TwoBitFile.h"
+
+
+/**
+ * @brief A class to write a simulation in checkpoints, s.t. an interrupted simulation can be resumed.
+ *
+ * @details The amplicons are streamed to the output file in chunks of primer pairs. After every chunk the output
+ *          is synced to disk and a manifest (the output file name with the suffix .checkpoint) records the parameters,
+ *          the first unfinished primer pair, the template and product counters, the size of the output and the
+ *          position of the random number stream. A resumed simulation truncates the output to the recorded size,
+ *          continues the random number stream and skips the finished primer pairs, hence the output is
+ *          byte-identical to an uninterrupted simulation. The simulation draws from a RandomSource seeded with the
+ *          seed, i.e. on glibc the output is also identical to a simulation without checkpoints.
+ */
+class CheckpointRun : public AmpliconSink{
+    private:
+        arguments *args;
+        arguments generator_args;               // the arguments without the messages of every chunk
+        PrimerIndex *primer_index;
+        std::vector<std::string> ref_genomes;
+        std::string bed_file;
+        std::string manifest_file;
+        RandomSource rng;
+        std::unique_ptr<AmpliconGenerator> generator;
+        int fd = -1;
+        std::string buffer;                     // the FASTA records of the current chunk
+        long contig = 0;                        // ordinal of the next contig passed to generate
+        long resume_contig = 0;                 // position of the first unfinished primer pair of the manifest
+        int resume_primer = 0;
+        int pending = 0;                        // primer pairs since the last checkpoint
+        long n_templates = 0;
+        long n_products = 0;
+        uint64_t output_bytes = 0;
+        int last_template = -1;
+        bool finished = false;
+
+        std::string parameters();
+        int read_manifest();
+        int checkpoint(long next_contig, int next_primer, bool finished);
+        template <class Sequence>
+        int generate_contig(const std::string &chr, const Sequence &sequence);
+
+        CheckpointRun(const CheckpointRun &) = delete;
+        CheckpointRun &operator=(const CheckpointRun &) = delete;
+
+    public:
+        CheckpointRun(arguments &arguments, const ErrorProfile &error_profile, std::vector<Primer> &primers, PrimerIndex &primer_index);
+        ~CheckpointRun();
+        int open(bool resume);
+        int generate(const std::string &chr, const std::string &sequence);
+        int generate(const std::string &chr, const TwoBitSequence &sequence);
+        int add(int template_index, std::string &amplicon) override;
+        int finish();
+        bool is_finished() const;
+        long size() const;
+};
+
+
+
+
+#endif // CHECKPOINT_RUN_H
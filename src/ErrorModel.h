@@ -0,0 +1,230 @@
+#ifndef ERROR_MODEL_H
+#define ERROR_MODEL_H
+
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <climits>
+
+#include "ErrorProfile.h"
+#include "RandomSource.h"
+
+
+/**
+ * @file ErrorModel.h contains the error models the Replicator is specialized on.
+ *       All probabilities of a profile are precomputed into integer thresholds on the
+ *       output of the RandomSource, s.t. a base only costs one comparison if it is replicated without error.
+ *       Every model provides:
+ *       - prepare(template)    : precompute the per base thresholds of a template (if any)
+ *       - threshold(i)         : random values above the threshold replicate base i without error
+ *       - mutate(base, replicate, rng) : append the erroneous replication of base to the replicate,
+ *                                        rng is any source whose next() draws from [0, RAND_MAX]
+ */
+
+
+/**
+ * @brief Convert a probability into a rand() threshold t, s.t. rand() > t has the probability 1-p.
+ */
+static inline int error_threshold(double p){
+    return (int) std::floor(p * RAND_MAX);
+}
+
+
+/**
+ * @brief Convert a cumulative probability into a rand() threshold t, s.t. rand() < t has the probability p.
+ */
+static inline int cumulative_threshold(double p){
+    return (int) std::min(std::ceil(p * RAND_MAX), (double) INT_MAX);
+}
+
+
+/**
+ * @brief Lookup table of the bases that differ from a given base.
+ *
+ */
+class UniformSubstitution{
+    private:
+        char alternatives[256][4];
+        int n_alternatives[256];
+    public:
+        UniformSubstitution(){
+            const char bases[4] = {'A', 'C', 'G', 'T'};
+            for (int c = 0; c < 256; c++){
+                int n = 0;
+                for (int b = 0; b < 4; b++){
+                    if (bases[b] != (char) c){
+                        this->alternatives[c][n++] = bases[b];
+                    }
+                }
+                this->n_alternatives[c] = n;
+            }
+        }
+        /**
+         * @brief Get a random base unequal to base (uniformly among A,C,G,T).
+         */
+        template <class Rng>
+        inline char substitute(const char base, Rng &rng) const{
+            const unsigned char c = (unsigned char) base;
+            return this->alternatives[c][rng.next() % this->n_alternatives[c]];
+        }
+};
+
+
+/**
+ * @brief Uniform error rate, substitutions only.
+ *
+ */
+class SubstitutionModel{
+    private:
+        int error;
+        UniformSubstitution substitution;
+    public:
+        SubstitutionModel(const ErrorProfile &profile) : error(error_threshold(profile.rate)) {}
+        inline void prepare(const std::string &) {}
+        inline int threshold(const int) const { return this->error; }
+        template <class Rng>
+        inline void mutate(const char base, std::string &replicate, Rng &rng) const{
+            replicate += this->substitution.substitute(base, rng);
+        }
+};
+
+
+/**
+ * @brief Uniform error rate with a fixed split between substitutions, insertions and deletions.
+ *
+ */
+class UniformIndelModel{
+    private:
+        int error;
+        int substitution_cum;
+        int insertion_cum;
+        UniformSubstitution substitution;
+    public:
+        UniformIndelModel(const ErrorProfile &profile) :
+            error(error_threshold(profile.rate)),
+            substitution_cum(cumulative_threshold(1.0 - profile.insertion - profile.deletion)),
+            insertion_cum(cumulative_threshold(1.0 - profile.deletion)) {}
+        inline void prepare(const std::string &) {}
+        inline int threshold(const int) const { return this->error; }
+        template <class Rng>
+        inline void mutate(const char base, std::string &replicate, Rng &rng) const{
+            const int r = rng.next();
+            if (r < this->substitution_cum){           // substitution, add random base
+                replicate += this->substitution.substitute(base, rng);
+            } else if (r < this->insertion_cum){       // insertion, add original base + random base
+                replicate += base;
+                replicate += "ACGT"[rng.next() % 4];
+            }                                           // deletion, skip original base
+        }
+};
+
+
+/**
+ * @brief Position and homopolymer dependent error rates with a substitution matrix.
+ *
+ * @details The error rate of a base is the rate of its insert position (or the default rate)
+ *          or the rate of the homopolymer it is part of, whichever is larger.
+ */
+class ContextModel{
+    private:
+        int error;
+        int substitution_cum;
+        int insertion_cum;
+        std::vector<int> position_thresholds;
+        std::vector<int> homopolymer_thresholds;    // indexed by homopolymer length
+        int substitution_cums[256][4];              // cumulative thresholds to substitute A,C,G,T
+        std::vector<int> thresholds;                // per base thresholds of the current template
+    public:
+        ContextModel(const ErrorProfile &profile) :
+            error(error_threshold(profile.rate)),
+            substitution_cum(cumulative_threshold(1.0 - profile.insertion - profile.deletion)),
+            insertion_cum(cumulative_threshold(1.0 - profile.deletion)){
+
+            for (auto &rate : profile.position_rates){
+                this->position_thresholds.push_back(rate < 0 ? this->error : error_threshold(rate));
+            }
+
+            // homopolymer thresholds by length, the longest specified length applies to all longer homopolymers
+            for (auto &hp : profile.homopolymer_rates){
+                if ((int) this->homopolymer_thresholds.size() <= hp.first){
+                    this->homopolymer_thresholds.resize(hp.first + 1, -1);
+                }
+                this->homopolymer_thresholds[hp.first] = error_threshold(hp.second);
+            }
+            for (size_t len = 1; len < this->homopolymer_thresholds.size(); len++){
+                this->homopolymer_thresholds[len] = std::max(this->homopolymer_thresholds[len], this->homopolymer_thresholds[len - 1]);
+            }
+
+            // cumulative substitution thresholds, any other character is substituted uniformly
+            const char bases[4] = {'A', 'C', 'G', 'T'};
+            for (int c = 0; c < 256; c++){
+                for (int b = 0; b < 4; b++){
+                    this->substitution_cums[c][b] = cumulative_threshold((b + 1) / 4.0);
+                }
+            }
+            for (int from = 0; from < 4; from++){
+                double sum = 0.0;
+                for (int to = 0; to < 4; to++){
+                    sum += (from == to) ? 0.0 : profile.substitution_matrix[from][to];
+                }
+                int *cums = this->substitution_cums[(unsigned char) bases[from]];
+                double cum = 0.0;
+                for (int to = 0; to < 4; to++){
+                    if (from != to){
+                        cum += (sum > 0) ? profile.substitution_matrix[from][to] / sum : 1.0 / 3.0;
+                    }
+                    cums[to] = cumulative_threshold(cum);
+                }
+                // the last base unequal to the original base catches all remaining rand() values
+                cums[from == 3 ? 2 : 3] = INT_MAX;
+            }
+        }
+
+        inline void prepare(const std::string &tmpl){
+            const int len = tmpl.size();
+            this->thresholds.resize(len);
+            const int n_pos = this->position_thresholds.size();
+            const int n_hp = this->homopolymer_thresholds.size();
+
+            int run_start = 0;
+            for (int i = 0; i < len; i++){
+                this->thresholds[i] = i < n_pos ? this->position_thresholds[i] : this->error;
+
+                // at the end of a homopolymer apply its threshold to all of its bases
+                if (i + 1 == len || tmpl[i + 1] != tmpl[i]){
+                    int run_length = i + 1 - run_start;
+                    if (n_hp > 0){
+                        int hp = this->homopolymer_thresholds[std::min(run_length, n_hp - 1)];
+                        for (int j = run_start; j <= i; j++){
+                            this->thresholds[j] = std::max(this->thresholds[j], hp);
+                        }
+                    }
+                    run_start = i + 1;
+                }
+            }
+        }
+        inline int threshold(const int i) const { return this->thresholds[i]; }
+        template <class Rng>
+        inline void mutate(const char base, std::string &replicate, Rng &rng) const{
+            const int r = rng.next();
+            if (r < this->substitution_cum){
+                const int *cums = this->substitution_cums[(unsigned char) base];
+                const int s = rng.next();
+                int b = 0;
+                while (b < 3 && s >= cums[b]){
+                    b++;
+                }
+                replicate += "ACGT"[b];
+            } else if (r < this->insertion_cum){
+                replicate += base;
+                replicate += "ACGT"[rng.next() % 4];
+            }
+        }
+};
+
+
+
+
+#endif // ERROR_MODEL_H
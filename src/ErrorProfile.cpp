@@ -0,0 +1,42 @@
+#include "ErrorProfile.h"
+
+
+/**
+ * @brief Construct a new uniform ErrorProfile object
+ * 
+ * @param rate The per base error rate.
+ * @param insertion The fraction of errors that are insertions.
+ * @param deletion The fraction of errors that are deletions.
+ */
+ErrorProfile::ErrorProfile(double rate, double insertion, double deletion){
+    this->rate = rate;
+    this->insertion = insertion;
+    this->deletion = deletion;
+    this->has_substitution_matrix = false;
+    for (int i = 0; i < 4; i++){
+        for (int j = 0; j < 4; j++){
+            this->substitution_matrix[i][j] = (i == j) ? 0.0 : 1.0;
+        }
+    }
+}
+
+
+/**
+ * @brief Get the kind of error model that is required to simulate the profile.
+ * 
+ * @return ErrorProfile::Kind SUBSTITUTION if the profile is uniform without indels,
+ *         UNIFORM_INDEL if the profile is uniform with indels,
+ *         CONTEXT if the profile has position, homopolymer or substitution specific rates.
+ */
+ErrorProfile::Kind ErrorProfile::kind() const{
+
+    if (!this->position_rates.empty() || !this->homopolymer_rates.empty() || this->has_substitution_matrix){
+        return CONTEXT;
+    }
+
+    if (this->insertion == 0.0 && this->deletion == 0.0){
+        return SUBSTITUTION;
+    }
+
+    return UNIFORM_INDEL;
+}
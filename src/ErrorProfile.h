@@ -0,0 +1,30 @@
+#ifndef ERROR_PROFILE_H
+#define ERROR_PROFILE_H
+
+#include <string>
+#include <vector>
+#include <utility>
+
+
+/**
+ * @brief A class to store the error profile of the polymerase used for the replications.
+ * 
+ */
+class ErrorProfile{
+    public:
+        enum Kind { SUBSTITUTION, UNIFORM_INDEL, CONTEXT };
+        double rate;                                            // default per base error rate
+        double insertion;                                       // fraction of errors that are insertions
+        double deletion;                                        // fraction of errors that are deletions
+        std::vector<double> position_rates;                     // per base error rate by insert position, negative if unset
+        std::vector<std::pair<int, double>> homopolymer_rates;  // per base error rate within homopolymers of at least this length
+        bool has_substitution_matrix;
+        double substitution_matrix[4][4];                       // weights of the substitutions A,C,G,T (row) to A,C,G,T (column)
+        ErrorProfile(double rate = 0.01, double insertion = 0.1, double deletion = 0.1);
+        Kind kind() const;
+};
+
+
+
+
+#endif // ERROR_PROFILE_H
@@ -0,0 +1,546 @@
+#include "MultiplexRun.h"
+
+#include <cmath>
+#include <cstdint>
+#include <sstream>
+#include <algorithm>
+#include <unordered_set>
+
+#include "ReferenceLoader.h"
+#include "TwoBitFile.h"
+#include "util.h"
+
+
+// number of primer pairs per chunk, i.e. per interleaved block of a sample
+static const int CHUNK_PAIRS = 16;
+
+
+/**
+ * @brief Check that a barcode consists of nucleotides only.
+ */
+static bool is_barcode(const std::string &barcode){
+    return !barcode.empty() && barcode.find_first_not_of("ACGTNacgtn") == std::string::npos;
+}
+
+
+/**
+ * @brief Construct a new MultiplexRun object.
+ *
+ * @param arguments The command line arguments, shared by all samples.
+ * @param error_profile The error profile of the replications.
+ * @param primers A vector of Primer objects.
+ * @param primer_index A PrimerIndex object.
+ */
+MultiplexRun::MultiplexRun(arguments &arguments, const ErrorProfile &error_profile, std::vector<Primer> &primers, PrimerIndex &primer_index){
+    this->args = &arguments;
+    this->error_profile = &error_profile;
+    this->primers = &primers;
+    this->primer_index = &primer_index;
+}
+
+
+/**
+ * @brief Destroy the MultiplexRun object, stop the workers and close the output if it is still open.
+ */
+MultiplexRun::~MultiplexRun(){
+    this->stop_workers();
+    if (this->bgzf != NULL){
+        bgzf_close(this->bgzf);
+    }
+}
+
+
+/**
+ * @brief Read the sample sheet.
+ *
+ * @details Every line holds the tab separated name, seed, barcode and references of a sample, lines starting
+ *          with '#' and a header line starting with "sample" are skipped. The barcode is BARCODE[+BARCODE2] or '-'
+ *          for none: the first barcode is prepended to the amplicons, the reverse complement of the second one is
+ *          appended. The references are a comma separated list of FILE[:WEIGHT] haplotypes, '-' (or a missing
+ *          column) stands for the REFERENCE files of the command line. The number of replications of a haplotype
+ *          is scaled by its share of the total weight.
+ * @param sample_sheet The name of the sample sheet.
+ * @param ref_genomes The names of the reference files of the command line.
+ * @return int 0 if the sample sheet is valid, 1 otherwise.
+ */
+int MultiplexRun::read_sample_sheet(const std::string &sample_sheet, const std::vector<std::string> &ref_genomes){
+
+    std::ifstream in(sample_sheet);
+    if (!in.is_open()){
+        std::cerr << "Error opening the sample sheet \'" << sample_sheet << "\'." << std::endl;
+        return 1;
+    }
+
+    std::unordered_set<std::string> names;
+    std::string line;
+    int line_number = 0;
+    while (std::getline(in, line)){
+
+        line_number++;
+        if (!line.empty() && line.back() == '\r'){
+            line.pop_back();
+        }
+        if (line.empty() || line[0] == '#'){
+            continue;
+        }
+
+        std::vector<std::string> fields;
+        std::istringstream iss(line);
+        std::string field;
+        while (std::getline(iss, field, '\t')){
+            fields.push_back(field);
+        }
+        if (fields[0] == "sample"){
+            continue;
+        }
+        if (fields.size() < 3 || fields.size() > 4){
+            std::cerr << "Error: line " << line_number << " of the sample sheet is not of the form NAME SEED BARCODE [REFERENCES]." << std::endl;
+            return 1;
+        }
+
+        std::unique_ptr<Sample> sample(new Sample());
+        sample->name = fields[0];
+        sample->strand = this->args->strand;
+        if (sample->name.empty() || sample->name.find_first_of(" :") != std::string::npos || !names.insert(sample->name).second){
+            std::cerr << "Error: invalid or duplicate sample name \'" << sample->name << "\' in line " << line_number << " of the sample sheet." << std::endl;
+            return 1;
+        }
+
+        char *end;
+        long seed = strtol(fields[1].c_str(), &end, 10);
+        if (fields[1].empty() || *end != '\0' || seed <= 0 || seed > INT32_MAX){
+            std::cerr << "Error: invalid seed \'" << fields[1] << "\' in line " << line_number << " of the sample sheet." << std::endl;
+            return 1;
+        }
+        sample->seed = (unsigned) seed;
+        sample->rng.reset(new RandomSource(sample->seed));
+
+        if (fields[2] != "-"){
+            size_t plus = fields[2].find('+');
+            sample->barcode = fields[2].substr(0, plus);
+            sample->barcode_end = (plus != std::string::npos) ? fields[2].substr(plus + 1) : "";
+            if (!is_barcode(sample->barcode) || (plus != std::string::npos && !is_barcode(sample->barcode_end))){
+                std::cerr << "Error: invalid barcode \'" << fields[2] << "\' in line " << line_number << " of the sample sheet." << std::endl;
+                return 1;
+            }
+            reverse_complement(sample->barcode_end);
+        }
+
+        // the haplotypes and their weights
+        std::string mixture = (fields.size() == 4 && !fields[3].empty()) ? fields[3] : "-";
+        std::istringstream mixture_stream(mixture);
+        std::string item;
+        double total_weight = 0;
+        while (std::getline(mixture_stream, item, ',')){
+            Haplotype haplotype;
+            haplotype.weight = 1.0;
+            size_t colon = item.rfind(':');
+            if (colon != std::string::npos){
+                haplotype.weight = strtod(item.c_str() + colon + 1, &end);
+                if (colon + 1 == item.size() || *end != '\0' || haplotype.weight <= 0){
+                    std::cerr << "Error: invalid weight in \'" << item << "\' in line " << line_number << " of the sample sheet." << std::endl;
+                    return 1;
+                }
+                item = item.substr(0, colon);
+            }
+            if (item == "-"){
+                haplotype.files = ref_genomes;
+            } else {
+                haplotype.files.push_back(item);
+            }
+            total_weight += haplotype.weight;
+            sample->haplotypes.push_back(std::move(haplotype));
+        }
+        if (sample->haplotypes.empty()){
+            std::cerr << "Error: no references in line " << line_number << " of the sample sheet." << std::endl;
+            return 1;
+        }
+
+        for (auto &haplotype : sample->haplotypes){
+            haplotype.weight /= total_weight;
+            haplotype.args = *this->args;
+            haplotype.args.verbose = false;
+            haplotype.args.mean = std::max(1, (int) std::round(this->args->mean * haplotype.weight));
+            haplotype.args.sd = (int) std::round(this->args->sd * haplotype.weight);
+        }
+
+        this->samples.push_back(std::move(sample));
+    }
+
+    if (this->samples.empty()){
+        std::cerr << "Error: the sample sheet \'" << sample_sheet << "\' contains no samples." << std::endl;
+        return 1;
+    }
+
+    return 0;
+}
+
+
+/**
+ * @brief Load the contigs of a set of reference files, every set is loaded once and shared by all samples.
+ *
+ * @param files The names of the reference files (FASTA or .2bit).
+ * @param reference A pointer to store the loaded reference.
+ * @return int 0 if the function was executed correctly, 1 otherwise.
+ */
+int MultiplexRun::load_reference(const std::vector<std::string> &files, const Reference *&reference){
+
+    std::string key;
+    for (auto &file : files){
+        key += file + '\t';
+    }
+    auto it = this->references.find(key);
+    if (it != this->references.end()){
+        reference = it->second.get();
+        return 0;
+    }
+
+    std::unique_ptr<Reference> loaded(new Reference());
+
+    int n_twobit = std::count_if(files.begin(), files.end(), TwoBitFile::is_twobit);
+    if (n_twobit > 0 && n_twobit < (int) files.size()){
+        std::cerr << "Error: mixing .2bit and FASTA references is not supported." << std::endl;
+        return 1;
+    }
+
+    if (n_twobit > 0){
+        for (auto &file : files){
+            TwoBitFile twobit_file;
+            if (twobit_file.open(file) != 0){
+                return 1;
+            }
+            for (int i = 0; i < twobit_file.n_sequences(); i++){
+                TwoBitSequence sequence;
+                if (twobit_file.get_sequence(i, sequence) != 0){
+                    return 1;
+                }
+                loaded->names.push_back(twobit_file.name(i));
+                loaded->sequences.push_back(sequence.substr(0, sequence.length()));
+            }
+        }
+    } else {
+        ReferenceLoader reference_loader(files, this->args->threads, this->args->verbose);
+        if (reference_loader.start() != 0){
+            return 1;
+        }
+        std::string chr, sequence;
+        while (reference_loader.next(chr, sequence)){
+            loaded->names.push_back(chr);
+            loaded->sequences.push_back(std::move(sequence));
+        }
+        if (reference_loader.has_failed()){
+            return 1;
+        }
+    }
+
+    // the first contig of a name is used, like by a single simulation
+    for (size_t i = 0; i < loaded->names.size(); i++){
+        loaded->index.emplace(loaded->names[i], i);
+    }
+
+    reference = loaded.get();
+    this->references[key] = std::move(loaded);
+
+    return 0;
+}
+
+
+/**
+ * @brief Load the references of all samples, create their generators and split the primer pairs into chunks.
+ *
+ * @details Every sample generates the contigs in the order of their first occurrence in its own references, like
+ *          a single simulation of these references.
+ * @return int 0 if the function was executed correctly, 1 otherwise.
+ */
+int MultiplexRun::load_references(){
+
+    for (auto &sample : this->samples){
+
+        std::unordered_set<std::string> seen;
+        std::vector<std::string> order;
+
+        for (auto &haplotype : sample->haplotypes){
+            if (this->load_reference(haplotype.files, haplotype.reference) != 0){
+                std::cerr << "Error reading the references of the sample \'" << sample->name << "\'." << std::endl;
+                return 1;
+            }
+            haplotype.generator.reset(new AmpliconGenerator(*this->primers, *this->primer_index, *this->error_profile, *sample->rng));
+            haplotype.generator->stream_to(*sample);
+            for (auto &name : haplotype.reference->names){
+                if (seen.insert(name).second){
+                    order.push_back(name);
+                }
+            }
+        }
+
+        for (auto &chr : order){
+            int index = this->primer_index->get_index(chr);
+            if (index == -1){
+                continue;
+            }
+            int runlength = this->primer_index->get_runlength(chr);
+            for (int first = index; first < index + runlength; first += CHUNK_PAIRS){
+                sample->chunks.push_back({chr, first, std::min(first + CHUNK_PAIRS, index + runlength)});
+            }
+        }
+        this->n_rounds = std::max(this->n_rounds, sample->chunks.size());
+    }
+
+    return 0;
+}
+
+
+/**
+ * @brief Orient an amplicon, add the barcodes and append its FASTA record to the current buffer of the sample.
+ *
+ * @param template_index The index of the amplicon template within the generator of the current haplotype.
+ * @param amplicon The amplicon (forward strand, reverse complemented in place if needed).
+ * @return int 0 if the function was executed correctly, 1 otherwise.
+ */
+int MultiplexRun::Sample::add(int template_index, std::string &amplicon){
+
+    Haplotype &haplotype = this->haplotypes[this->current_haplotype];
+    if (haplotype.last_template != template_index){
+        haplotype.last_template = template_index;
+        this->n_templates++;
+    }
+
+    if (this->strand != "forward" && is_reverse_strand(this->strand == "random", this->seed, this->n_products)){
+        reverse_complement(amplicon);
+    }
+
+    std::string &out = this->buffers[this->current_buffer];
+    out += '>';
+    out += this->name;
+    out += ":amplicon_";
+    out += std::to_string(this->n_templates - 1);
+    out += '_';
+    out += std::to_string(this->n_products);
+    out += '\n';
+    out += this->barcode;
+    out += amplicon;
+    out += this->barcode_end;
+    out += '\n';
+    this->n_products++;
+
+    return 0;
+}
+
+
+/**
+ * @brief Generate the amplicons of a chunk of primer pairs for a sample.
+ *
+ * @param sample The sample.
+ * @param k The index of the chunk, a sample with fewer chunks generates nothing.
+ * @param buffer The index of the buffer of the sample to store the FASTA records.
+ * @return int 0 if the function was executed correctly, 1 otherwise.
+ */
+int MultiplexRun::generate_chunk(Sample &sample, size_t k, int buffer){
+
+    sample.current_buffer = buffer;
+    sample.buffers[buffer].clear();
+    if (k >= sample.chunks.size()){
+        return 0;
+    }
+    const Chunk &chunk = sample.chunks[k];
+
+    std::vector<std::string> amplicons;     // unused, the amplicons are streamed to the sample
+    for (size_t h = 0; h < sample.haplotypes.size(); h++){
+        Haplotype &haplotype = sample.haplotypes[h];
+        auto contig = haplotype.reference->index.find(chunk.chr);
+        if (contig == haplotype.reference->index.end()){
+            continue;
+        }
+        sample.current_haplotype = h;
+        if (haplotype.generator->generate_range(chunk.chr, haplotype.reference->sequences[contig->second], chunk.first, chunk.last, amplicons, haplotype.args) != 0){
+            std::cerr << "Error generating the amplicons of the sample \'" << sample.name << "\'." << std::endl;
+            return 1;
+        }
+    }
+
+    return 0;
+}
+
+
+/**
+ * @brief Write a buffer of every sample to the pooled output, in the order of the sample sheet.
+ *
+ * @param buffer The index of the buffer.
+ * @return int 0 if the function was executed correctly, 1 otherwise.
+ */
+int MultiplexRun::write_chunk(int buffer){
+
+    std::ostream &out = (this->args->output_file != NULL) ? this->file : std::cout;
+
+    for (auto &sample : this->samples){
+        const std::string &records = sample->buffers[buffer];
+        if (this->bgzf != NULL){
+            if (bgzf_write(this->bgzf, records.data(), records.size()) < 0){
+                return 1;
+            }
+        } else {
+            out.write(records.data(), records.size());
+        }
+    }
+
+    return (this->bgzf != NULL || out.good()) ? 0 : 1;
+}
+
+
+/**
+ * @brief Generate the samples of the rounds, the loop of a worker thread.
+ *
+ * @details A round generates the chunk of the round of every sample into the buffer of the round.
+ */
+void MultiplexRun::generate_rounds(){
+
+    std::unique_lock<std::mutex> lock(this->mutex);
+    while (true){
+        this->cond_round.wait(lock, [this]{ return this->stopped || this->next_sample < this->samples.size(); });
+        if (this->stopped){
+            return;
+        }
+        const size_t s = this->next_sample++;
+        const size_t k = this->round;
+        lock.unlock();
+
+        const int ret = this->generate_chunk(*this->samples[s], k, k % 2);
+
+        lock.lock();
+        if (ret != 0){
+            this->failed = true;
+        }
+        if (++this->n_done == this->samples.size()){
+            this->cond_done.notify_one();
+        }
+    }
+}
+
+
+/**
+ * @brief Stop the worker threads and wait for them.
+ */
+void MultiplexRun::stop_workers(){
+
+    {
+        std::lock_guard<std::mutex> lock(this->mutex);
+        this->stopped = true;
+    }
+    this->cond_round.notify_all();
+    for (auto &worker : this->workers){
+        worker.join();
+    }
+    this->workers.clear();
+}
+
+
+/**
+ * @brief Generate all samples into the pooled output.
+ *
+ * @details The worker threads generate the chunks of a round while the chunks of the previous round are written.
+ * @return int 0 if the function was executed correctly, 1 otherwise.
+ */
+int MultiplexRun::run(){
+
+    const char *output_file = this->args->output_file;
+    if (output_file != NULL){
+        std::string name = output_file;
+        if (name.size() > 3 && name.compare(name.size() - 3, 3, ".gz") == 0){
+            this->bgzf = bgzf_open(output_file, "w");
+            if (this->bgzf != NULL && this->args->threads > 1){
+                bgzf_mt(this->bgzf, this->args->threads, 256);
+            }
+        } else {
+            this->file.open(output_file);
+        }
+        if (this->bgzf == NULL && !this->file.is_open()){
+            std::cerr << "Error opening the output file \'" << output_file << "\'." << std::endl;
+            return 1;
+        }
+    }
+
+    if (this->args->verbose){
+        std::cout << "Generating amplicons for " << this->samples.size() << " samples in " << this->n_rounds << " chunks..." << std::endl;
+    }
+
+    const size_t n_samples = this->samples.size();
+    const size_t n_workers = std::max(1, std::min(this->args->threads, (int) n_samples));
+
+    // no round is started until the first one is handed out
+    this->next_sample = n_samples;
+    for (size_t w = 0; w < n_workers; w++){
+        this->workers.push_back(std::thread(&MultiplexRun::generate_rounds, this));
+    }
+
+    for (size_t k = 0; k <= this->n_rounds; k++){
+
+        if (k < this->n_rounds){
+            std::lock_guard<std::mutex> lock(this->mutex);
+            this->round = k;
+            this->next_sample = 0;
+            this->n_done = 0;
+        }
+        this->cond_round.notify_all();
+
+        int ret = (k > 0) ? this->write_chunk((k - 1) % 2) : 0;
+
+        bool failed;
+        {
+            std::unique_lock<std::mutex> lock(this->mutex);
+            this->cond_done.wait(lock, [&]{ return k == this->n_rounds || this->n_done == n_samples; });
+            failed = this->failed;
+        }
+        if (failed){
+            this->stop_workers();
+            return 1;
+        }
+        if (ret != 0){
+            this->stop_workers();
+            std::cerr << "Error writing the output file." << std::endl;
+            return 1;
+        }
+    }
+    this->stop_workers();
+
+    int ret = 0;
+    if (this->bgzf != NULL){
+        ret = bgzf_close(this->bgzf);
+        this->bgzf = NULL;
+    } else if (output_file != NULL){
+        this->file.close();
+        ret = this->file.fail() ? 1 : 0;
+    } else {
+        std::cout.flush();
+    }
+    if (ret != 0){
+        std::cerr << "Error writing the output file \'" << output_file << "\'." << std::endl;
+        return 1;
+    }
+
+    long n_products = 0;
+    for (auto &sample : this->samples){
+        n_products += sample->n_products;
+    }
+    if (n_products == 0){
+        std::cout << "WARNING: No amplicons were generated." << std::endl;
+        return 1;
+    }
+
+    return 0;
+}
+
+
+/**
+ * @brief Write a tab separated summary of the samples.
+ *
+ * @param out The output stream.
+ */
+void MultiplexRun::write_summary(std::ostream &out){
+
+    out << "sample\tseed\thaplotypes\ttemplates\tproducts\n";
+    for (auto &sample : this->samples){
+        out << sample->name << '\t' << sample->seed << '\t' << sample->haplotypes.size() << '\t'
+            << sample->n_templates << '\t' << sample->n_products << '\n';
+    }
+    out.flush();
+}
@@ -0,0 +1,111 @@
+#ifndef MULTIPLEX_RUN_H
+#define MULTIPLEX_RUN_H
+
+#include <string>
+#include <vector>
+#include <memory>
+#include <fstream>
+#include <iostream>
+#include <unordered_map>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <htslib/bgzf.h>
+
+#include "argparser.h"
+#include "Primer.h"
+#include "PrimerIndex.h"
+#include "ErrorProfile.h"
+#include "RandomSource.h"
+#include "AmpliconGenerator.h"
+
+
+/**
+ * @brief A class to simulate the samples of a multiplexed sequencing run into one pooled output.
+ *
+ * @details The samples are read from a tab separated sample sheet (name, seed, barcode and reference or haplotype mixture).
+ *          All samples share the primers, the primer index and the loaded references, every reference is loaded once.
+ *          Every sample draws from its own RandomSource seeded with its seed and generates the contigs in the order
+ *          of its own references, hence on glibc a sample of a single reference generates the same amplicons as a
+ *          single simulation with that seed. The primer pairs of a sample are generated in chunks: a persistent pool of
+ *          worker threads generates the next chunk of every sample while the previous chunks are written, and the
+ *          chunks of the samples are interleaved in the order of the sample sheet. The pooled output is bgzip
+ *          compressed if its name ends with .gz.
+ */
+class MultiplexRun{
+    private:
+        struct Reference{
+            std::vector<std::string> names;
+            std::vector<std::string> sequences;
+            std::unordered_map<std::string, size_t> index;
+        };
+        struct Haplotype{
+            std::vector<std::string> files;
+            double weight;
+            const Reference *reference = NULL;
+            arguments args;                                 // the number of replications scaled by the weight
+            std::unique_ptr<AmpliconGenerator> generator;
+            int last_template = -1;
+        };
+        struct Chunk{
+            std::string chr;
+            int first;
+            int last;
+        };
+        struct Sample : public AmpliconSink{
+            std::string name;
+            unsigned seed;
+            std::string barcode;        // prepended to every amplicon
+            std::string barcode_end;    // reverse complement of the second index, appended to every amplicon
+            std::string strand;
+            std::unique_ptr<RandomSource> rng;
+            std::vector<Haplotype> haplotypes;
+            std::vector<Chunk> chunks;  // the primer pairs in the contig order of the references of the sample
+            size_t current_haplotype = 0;
+            std::string buffers[2];     // FASTA records of the chunk being generated and of the chunk being written
+            int current_buffer = 0;
+            long n_templates = 0;
+            long n_products = 0;
+            int add(int template_index, std::string &amplicon) override;
+        };
+        arguments *args;
+        const ErrorProfile *error_profile;
+        std::vector<Primer> *primers;
+        PrimerIndex *primer_index;
+        std::vector<std::unique_ptr<Sample>> samples;
+        std::unordered_map<std::string, std::unique_ptr<Reference>> references;    // keyed by the tab joined file names
+        size_t n_rounds = 0;                        // chunks of the sample with the most chunks
+        std::ofstream file;
+        BGZF *bgzf = NULL;
+        std::vector<std::thread> workers;
+        std::mutex mutex;
+        std::condition_variable cond_round;         // a round was started (or the workers are stopped)
+        std::condition_variable cond_done;          // all samples of the round are generated
+        size_t round = 0;                           // the chunk index the workers generate
+        size_t next_sample = 0;
+        size_t n_done = 0;
+        bool stopped = false;
+        bool failed = false;
+
+        int load_reference(const std::vector<std::string> &files, const Reference *&reference);
+        int generate_chunk(Sample &sample, size_t k, int buffer);
+        int write_chunk(int buffer);
+        void generate_rounds();
+        void stop_workers();
+
+        MultiplexRun(const MultiplexRun &) = delete;
+        MultiplexRun &operator=(const MultiplexRun &) = delete;
+
+    public:
+        MultiplexRun(arguments &arguments, const ErrorProfile &error_profile, std::vector<Primer> &primers, PrimerIndex &primer_index);
+        ~MultiplexRun();
+        int read_sample_sheet(const std::string &sample_sheet, const std::vector<std::string> &ref_genomes);
+        int load_references();
+        int run();
+        void write_summary(std::ostream &out);
+};
+
+
+
+
+#endif // MULTIPLEX_RUN_H
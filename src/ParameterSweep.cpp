@@ -0,0 +1,332 @@
+#include "ParameterSweep.h"
+
+#include <random>
+#include <sstream>
+#include <algorithm>
+
+#include "Replicator.h"
+#include "util.h"
+
+
+/**
+ * @brief Construct a new ParameterSweep object.
+ *
+ * @param arguments The command line arguments, the values of the parameters that are not swept.
+ * @param error_profile The error profile of the replications, its rate is replaced by the swept error rates.
+ * @param primers A vector of Primer objects.
+ * @param primer_index A PrimerIndex object.
+ */
+ParameterSweep::ParameterSweep(arguments &arguments, const ErrorProfile &error_profile, std::vector<Primer> &primers, PrimerIndex &primer_index){
+    this->args = &arguments;
+    this->error_profile = &error_profile;
+    this->primers = &primers;
+    this->primer_index = &primer_index;
+}
+
+
+/**
+ * @brief Parse the swept values and build the grid.
+ *
+ * @param specs The sweep specifications "KEY=VALUE,VALUE,..." with KEY error-rate, mean, sd or dropout.
+ * @return int 0 if the specifications are valid (every key at most once, no repeated values), 1 otherwise.
+ */
+int ParameterSweep::parse(const std::vector<char *> &specs){
+
+    std::vector<double> error_rates(1, this->args->error_rate);
+    std::vector<double> means(1, this->args->mean);
+    std::vector<double> sds(1, this->args->sd);
+    std::vector<double> dropouts(1, this->args->dropout);
+
+    std::vector<std::string> keys;
+    for (auto &spec : specs){
+
+        std::string s = spec;
+        size_t eq = s.find('=');
+        if (eq == std::string::npos){
+            std::cerr << "Error: the sweep \'" << s << "\' is not of the form KEY=VALUE,VALUE,..." << std::endl;
+            return 1;
+        }
+        std::string key = s.substr(0, eq);
+        if (std::find(keys.begin(), keys.end(), key) != keys.end()){
+            std::cerr << "Error: the sweep parameter \'" << key << "\' is given more than once." << std::endl;
+            return 1;
+        }
+        keys.push_back(key);
+
+        std::vector<double> values;
+        std::istringstream iss(s.substr(eq + 1));
+        std::string value;
+        while (std::getline(iss, value, ',')){
+            char *end;
+            double v = strtod(value.c_str(), &end);
+            if (value.empty() || *end != '\0'){
+                std::cerr << "Error: invalid value \'" << value << "\' in the sweep \'" << s << "\'." << std::endl;
+                return 1;
+            }
+            values.push_back(v);
+        }
+
+        bool valid = !values.empty();
+        for (auto &v : values){
+            if (key == "error-rate"){
+                valid &= (v >= 0 && v <= 1);
+            } else if (key == "mean"){
+                valid &= (v > 0 && v == (int) v);
+            } else if (key == "sd"){
+                valid &= (v >= 0 && v == (int) v);
+            } else if (key == "dropout"){
+                valid &= (v >= 0 && v < 1);
+            } else {
+                std::cerr << "Error: unknown sweep parameter \'" << key << "\' (error-rate, mean, sd or dropout)." << std::endl;
+                return 1;
+            }
+        }
+        if (!valid){
+            std::cerr << "Error: invalid values in the sweep \'" << s << "\'." << std::endl;
+            return 1;
+        }
+
+        // a repeated value would write two grid points to the same file, hence the values are compared as written
+        std::vector<std::string> written;
+        for (auto &v : values){
+            std::ostringstream oss;
+            oss << v;
+            written.push_back(oss.str());
+        }
+        std::sort(written.begin(), written.end());
+        if (std::adjacent_find(written.begin(), written.end()) != written.end()){
+            std::cerr << "Error: repeated values in the sweep \'" << s << "\'." << std::endl;
+            return 1;
+        }
+
+        if (key == "error-rate") error_rates = values;
+        if (key == "mean") means = values;
+        if (key == "sd") sds = values;
+        if (key == "dropout") dropouts = values;
+    }
+
+    this->error_rates = error_rates;
+    std::sort(this->error_rates.begin(), this->error_rates.end());
+
+    // the grid is the cartesian product of the values
+    for (auto &error_rate : error_rates){
+        for (auto &mean : means){
+            for (auto &sd : sds){
+                for (auto &dropout : dropouts){
+                    GridPoint point;
+                    point.error_rate = error_rate;
+                    point.mean = (int) mean;
+                    point.sd = (int) sd;
+                    point.dropout = dropout;
+                    std::ostringstream key;
+                    key << "e" << error_rate << "_m" << point.mean << "_n" << point.sd << "_x" << dropout;
+                    point.file = partition_file_name(this->args->output_file, key.str());
+                    this->points.push_back(std::move(point));
+                }
+            }
+        }
+    }
+
+    return 0;
+}
+
+
+/**
+ * @brief Open the output file of every grid point.
+ *
+ * @return int 0 if all files were opened, 1 otherwise.
+ */
+int ParameterSweep::open(){
+
+    for (auto &point : this->points){
+        point.out.reset(new std::ofstream(point.file));
+        if (!point.out->is_open()){
+            std::cerr << "Error opening the output file \'" << point.file << "\'." << std::endl;
+            return 1;
+        }
+    }
+
+    return 0;
+}
+
+
+/**
+ * @brief Generate the amplicons of all grid points for a single chromosome.
+ *
+ * @param chr The name of the chromosome.
+ * @param sequence The sequence of the chromosome.
+ * @return int 0 if the function was executed correctly, 1 otherwise.
+ */
+int ParameterSweep::generate(const std::string &chr, const std::string &sequence){
+    return this->dispatch(chr, sequence);
+}
+
+
+/**
+ * @brief Generate the amplicons of all grid points for a single chromosome of a .2bit file.
+ *
+ * @param chr The name of the chromosome.
+ * @param sequence The memory mapped sequence of the chromosome.
+ * @return int 0 if the function was executed correctly, 1 otherwise.
+ */
+int ParameterSweep::generate(const std::string &chr, const TwoBitSequence &sequence){
+    return this->dispatch(chr, sequence);
+}
+
+
+/**
+ * @brief Dispatch to the generator that is specialized on the error model of the profile.
+ *
+ * @details The error rate does not change the kind of the profile, hence all grid points share the model.
+ */
+template <class Sequence>
+int ParameterSweep::dispatch(const std::string &chr, const Sequence &sequence){
+
+    switch (this->error_profile->kind()){
+        case ErrorProfile::SUBSTITUTION:
+            return this->generate<SubstitutionModel>(chr, sequence);
+        case ErrorProfile::UNIFORM_INDEL:
+            return this->generate<UniformIndelModel>(chr, sequence);
+        case ErrorProfile::CONTEXT:
+            return this->generate<ContextModel>(chr, sequence);
+    }
+
+    return 1;
+}
+
+
+/**
+ * @brief Generate the amplicons of all grid points for a single chromosome with a given error model.
+ *
+ * @tparam ErrorModel The error model of the replications.
+ * @tparam Sequence The type of the sequence (std::string or TwoBitSequence).
+ * @param chr The name of the chromosome.
+ * @param sequence The sequence of the chromosome.
+ * @return int 0 if the function was executed correctly, 1 otherwise.
+ */
+template <class ErrorModel, class Sequence>
+int ParameterSweep::generate(const std::string &chr, const Sequence &sequence){
+
+    int index = this->primer_index->get_index(chr);
+    if (index == -1){
+        return 0;
+    }
+
+    if (this->args->verbose){
+        std::cout << "Generating amplicons for " << chr << "..." << std::endl;
+    }
+
+    // one replicator per error rate, the error model tables are precomputed once per chromosome
+    std::vector<Replicator<ErrorModel>> replicators;
+    for (auto &error_rate : this->error_rates){
+        ErrorProfile profile = *this->error_profile;
+        profile.rate = error_rate;
+        replicators.push_back(Replicator<ErrorModel>(ErrorModel(profile)));
+    }
+
+    int runlength = this->primer_index->get_runlength(chr);
+    const uint64_t seed = (unsigned) this->args->seed;
+
+    for (int i = index; i < index + runlength; i++){
+
+        // the draws of a primer pair only depend on the seed and the primer pair index
+        const uint64_t pair_seed = RandomSource::derive(seed, i);
+        const double u_dropout = (RandomSource::derive(pair_seed, 0) >> 11) * (1.0 / 9007199254740992.0);
+        std::mt19937 gen((unsigned) RandomSource::derive(pair_seed, 1));
+        std::normal_distribution<> d(0.0, 1.0);
+        const double z = d(gen);
+
+        const Primer &primer = this->primers->at(i);
+        std::string left_primer = sequence.substr(primer.start_left, primer.end_left - primer.start_left);
+        std::string right_primer = sequence.substr(primer.start_right, primer.end_right - primer.start_right);
+        std::string insert = sequence.substr(primer.end_left, primer.start_right - primer.end_left);
+
+        for (size_t r = 0; r < this->error_rates.size(); r++){
+
+            // the replicates of the error rate are shared by all of its grid points
+            int max_replications = 0;
+            for (auto &point : this->points){
+                if (point.error_rate == this->error_rates[r] && u_dropout >= point.dropout){
+                    max_replications = std::max(max_replications, std::max(1, (int) (point.mean + point.sd * z)));
+                }
+            }
+            if (max_replications == 0){
+                continue;
+            }
+
+            std::vector<std::string> replicates;
+            if (replicators[r].replicate_coupled(insert, max_replications, RandomSource::derive(pair_seed, 2), replicates) != 0){
+                std::cerr << "Error replicating the insert sequence." << std::endl;
+                return 1;
+            }
+
+            for (auto &point : this->points){
+                if (point.error_rate != this->error_rates[r] || u_dropout < point.dropout){
+                    continue;
+                }
+                // +1 to account for the original sequence
+                int reps = std::max(1, (int) (point.mean + point.sd * z)) + 1;
+                point.n_templates++;
+                for (int k = 0; k < reps; k++){
+                    this->write_product(point, left_primer + replicates[k] + right_primer);
+                }
+            }
+        }
+    }
+
+    return 0;
+}
+
+
+/**
+ * @brief Orient an amplicon and write it to the file of its grid point.
+ *
+ * @param point The grid point.
+ * @param amplicon The amplicon (forward strand).
+ */
+void ParameterSweep::write_product(GridPoint &point, std::string amplicon){
+
+    const std::string strand = this->args->strand;
+    if (strand != "forward" && is_reverse_strand(strand == "random", (unsigned) this->args->seed, point.n_products)){
+        reverse_complement(amplicon);
+    }
+
+    *point.out << ">amplicon_" << point.n_templates - 1 << "_" << point.n_products << '\n' << amplicon << '\n';
+    point.n_products++;
+}
+
+
+/**
+ * @brief Close the output files.
+ *
+ * @return int 0 if all files were written correctly, 1 otherwise.
+ */
+int ParameterSweep::close(){
+
+    int ret = 0;
+    for (auto &point : this->points){
+        point.out->close();
+        if (point.out->fail()){
+            std::cerr << "Error writing the output file \'" << point.file << "\'." << std::endl;
+            ret = 1;
+        }
+    }
+
+    return ret;
+}
+
+
+/**
+ * @brief Write a tab separated summary of the grid points.
+ *
+ * @param out The output stream.
+ */
+void ParameterSweep::write_summary(std::ostream &out){
+
+    out << "file\terror_rate\tmean\tsd\tdropout\ttemplates\tproducts\n";
+    for (auto &point : this->points){
+        out << point.file << '\t' << point.error_rate << '\t' << point.mean << '\t' << point.sd << '\t'
+            << point.dropout << '\t' << point.n_templates << '\t' << point.n_products << '\n';
+    }
+    out.flush();
+}
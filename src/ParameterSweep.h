@@ -0,0 +1,69 @@
+#ifndef PARAMETER_SWEEP_H
+#define PARAMETER_SWEEP_H
+
+#include <string>
+#include <vector>
+#include <memory>
+#include <fstream>
+#include <iostream>
+
+#include "argparser.h"
+#include "Primer.h"
+#include "PrimerIndex.h"
+#include "ErrorProfile.h"
+#include "RandomSource.h"
+#include "TwoBitFile.h"
+
+
+/**
+ * @brief A class to simulate a grid of (error rate, mean, sd, dropout) values in one pass with common random numbers.
+ *
+ * @details The templates are extracted once for all grid points. All random draws of a primer pair are derived
+ *          from the seed and the primer pair index only, s.t. the grid points are coupled:
+ *          - the dropout of a primer pair is one uniform draw compared with every dropout value
+ *          - the number of replications is max(1, (int) (mean + sd * z)) with one standard normal draw z
+ *          - the replications are drawn by Replicator::replicate_coupled, i.e. the grid points with the
+ *            same error rate share their replicates (fewer replications are a prefix of more replications)
+ *            and the error draws are keyed by the replication and the template position
+ *          Hence the grid costs about one simulation per error rate and the differences between the
+ *          grid points are not blurred by independent draws. Every grid point is written to its own FASTA file.
+ */
+class ParameterSweep{
+    private:
+        struct GridPoint{
+            double error_rate;
+            int mean;
+            int sd;
+            double dropout;
+            std::string file;
+            std::unique_ptr<std::ofstream> out;
+            long n_templates = 0;
+            long n_products = 0;
+        };
+        arguments *args;
+        const ErrorProfile *error_profile;
+        std::vector<Primer> *primers;
+        PrimerIndex *primer_index;
+        std::vector<GridPoint> points;
+        std::vector<double> error_rates;        // distinct error rates of the grid
+
+        template <class Sequence>
+        int dispatch(const std::string &chr, const Sequence &sequence);
+        template <class ErrorModel, class Sequence>
+        int generate(const std::string &chr, const Sequence &sequence);
+        void write_product(GridPoint &point, std::string amplicon);
+
+    public:
+        ParameterSweep(arguments &arguments, const ErrorProfile &error_profile, std::vector<Primer> &primers, PrimerIndex &primer_index);
+        int parse(const std::vector<char *> &specs);
+        int open();
+        int generate(const std::string &chr, const std::string &sequence);
+        int generate(const std::string &chr, const TwoBitSequence &sequence);
+        int close();
+        void write_summary(std::ostream &out);
+};
+
+
+
+
+#endif // PARAMETER_SWEEP_H
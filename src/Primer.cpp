@@ -9,11 +9,13 @@
  * @param end_left The end position of the left primer.
  * @param start_right The start position of the right primer.
  * @param end_right The end position of the right primer.
+ * @param pool The primer pool of the primer pair (empty if unknown).
  */
-Primer::Primer(std::string chr, int start_left, int end_left, int start_right, int end_right){
+Primer::Primer(std::string chr, int start_left, int end_left, int start_right, int end_right, std::string pool){
     this->chr = chr;
     this->start_left = start_left;
     this->end_left = end_left;
     this->start_right = start_right;
     this->end_right = end_right;
+    this->pool = pool;
 }
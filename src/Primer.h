@@ -15,7 +15,8 @@ class Primer{
         int end_left;
         int start_right;
         int end_right;
-        Primer(std::string chr, int start_left, int end_left, int start_right, int end_right);
+        std::string pool;
+        Primer(std::string chr, int start_left, int end_left, int start_right, int end_right, std::string pool = "");
 };
 
 
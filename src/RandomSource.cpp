@@ -0,0 +1,103 @@
+#include "RandomSource.h"
+
+#include <sstream>
+
+
+/**
+ * @brief Construct a new RandomSource object that draws from the global rand() of the C library.
+ */
+RandomSource::RandomSource(){
+    this->use_libc = true;
+    this->front = 3;
+    this->rear = 0;
+    for (int i = 0; i < 31; i++){
+        this->state[i] = 0;
+    }
+}
+
+
+/**
+ * @brief Construct a new RandomSource object with its own generator state.
+ * 
+ * @param seed The random seed.
+ */
+RandomSource::RandomSource(unsigned int seed){
+    this->use_libc = false;
+
+    // the seed must not be 0
+    if (seed == 0){
+        seed = 1;
+    }
+
+    // state[i] = (16807 * state[i - 1]) % 2147483647 without overflowing 31 bits
+    int32_t word = (int32_t) seed;
+    this->state[0] = word;
+    for (int i = 1; i < 31; i++){
+        long hi = word / 127773;
+        long lo = word % 127773;
+        word = (int32_t) (16807 * lo - 2836 * hi);
+        if (word < 0){
+            word += 2147483647;
+        }
+        this->state[i] = word;
+    }
+
+    this->front = 3;
+    this->rear = 0;
+
+    // discard the first 310 numbers
+    for (int i = 0; i < 310; i++){
+        this->next_owned();
+    }
+}
+
+
+/**
+ * @brief Get the position of the owned generator in its stream.
+ * 
+ * @return std::string The front and rear index followed by the 31 state words, separated by spaces.
+ */
+std::string RandomSource::get_state() const{
+    std::ostringstream oss;
+    oss << this->front << ' ' << this->rear;
+    for (int i = 0; i < 31; i++){
+        oss << ' ' << this->state[i];
+    }
+    return oss.str();
+}
+
+
+/**
+ * @brief Continue the stream of the owned generator from a position returned by get_state.
+ * 
+ * @param state The front and rear index (both in [0, 31)) followed by exactly 31 state words, separated by spaces.
+ * @return int 0 if the state is valid, 1 otherwise.
+ */
+int RandomSource::set_state(const std::string &state){
+
+    std::istringstream iss(state);
+    int front, rear;
+    int32_t words[31];
+    if (!(iss >> front >> rear) || front < 0 || front >= 31 || rear < 0 || rear >= 31 || (front - rear + 31) % 31 != 3){
+        return 1;
+    }
+    for (int i = 0; i < 31; i++){
+        if (!(iss >> words[i])){
+            return 1;
+        }
+    }
+    // nothing but white space may follow the state words
+    std::string rest;
+    if (iss >> rest){
+        return 1;
+    }
+
+    this->use_libc = false;
+    this->front = front;
+    this->rear = rear;
+    for (int i = 0; i < 31; i++){
+        this->state[i] = words[i];
+    }
+
+    return 0;
+}
@@ -0,0 +1,87 @@
+#ifndef RANDOM_SOURCE_H
+#define RANDOM_SOURCE_H
+
+#include <cstdlib>
+#include <cstdint>
+#include <string>
+
+
+/**
+ * @brief A source of random integers in [0, RAND_MAX] for the simulation.
+ * 
+ * @details By default the source draws from the global rand() of the C library (seeded with srand()).
+ *          A seeded source owns its state instead, s.t. independent simulations can run concurrently.
+ *          The owned generator is the additive feedback generator of the GNU C library (random_r, TYPE_3),
+ *          i.e. on glibc a seeded source draws the same numbers as srand(seed) followed by rand().
+ */
+class RandomSource{
+    private:
+        bool use_libc;
+        int32_t state[31];
+        int front;
+        int rear;
+        int32_t next_owned();
+    public:
+        RandomSource();
+        RandomSource(unsigned int seed);
+        std::string get_state() const;
+        int set_state(const std::string &state);
+
+        /**
+         * @brief Derive the seed of an independent stream from a seed and a stream index (splitmix64).
+         */
+        static inline uint64_t derive(uint64_t seed, uint64_t index){
+            uint64_t z = seed + (index + 1) * 0x9E3779B97F4A7C15ULL;
+            z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+            z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+            return z ^ (z >> 31);
+        }
+
+        /**
+         * @brief Draw the next random integer in [0, RAND_MAX].
+         */
+        inline int next(){
+            return this->use_libc ? rand() : (int) this->next_owned();
+        }
+};
+
+
+
+/**
+ * @brief Draw the next random integer of the owned generator.
+ */
+inline int32_t RandomSource::next_owned(){
+    uint32_t val = (uint32_t) this->state[this->front] + (uint32_t) this->state[this->rear];
+    this->state[this->front] = (int32_t) val;
+    if (++this->front == 31) this->front = 0;
+    if (++this->rear == 31) this->rear = 0;
+    return (int32_t) (val >> 1);
+}
+
+
+
+/**
+ * @brief A cheap stream of random integers in [0, RAND_MAX] from a 64 bit seed (splitmix64).
+ *
+ * @details Unlike a seeded RandomSource the stream has no state to warm up, s.t. a stream per replication or
+ *          per base costs nothing to create. It does not draw the numbers of rand().
+ */
+class SplitMixStream{
+    private:
+        uint64_t seed;
+        uint64_t index = 0;
+    public:
+        explicit SplitMixStream(uint64_t seed) : seed(seed) {}
+
+        /**
+         * @brief Draw the next random integer in [0, RAND_MAX].
+         */
+        inline int next(){
+            return (int) ((RandomSource::derive(this->seed, this->index++) >> 32) % ((uint64_t) RAND_MAX + 1));
+        }
+};
+
+
+
+
+#endif // RANDOM_SOURCE_H
@@ -0,0 +1,251 @@
+#include "ReferenceLoader.h"
+
+
+
+/**
+ * @brief Construct a new ReferenceLoader object.
+ *
+ * @param fasta_files The names of the reference FASTA files (plain or bgzip compressed).
+ * @param n_threads The number of worker threads to load the contigs with.
+ * @param verbose A boolean to print messages to the user.
+ */
+ReferenceLoader::ReferenceLoader(const std::vector<std::string> &fasta_files, const int n_threads, const bool verbose){
+    this->fasta_files = fasta_files;
+    this->n_threads = n_threads > 0 ? n_threads : 1;
+    this->verbose = verbose;
+}
+
+
+/**
+ * @brief Destroy the ReferenceLoader object and wait for all worker threads.
+ */
+ReferenceLoader::~ReferenceLoader(){
+
+    // stop handing out new jobs to the workers
+    {
+        std::lock_guard<std::mutex> lock(this->mutex);
+        this->next_job = this->contigs.size();
+    }
+    this->cond_consumed.notify_all();
+
+    for (auto &worker : this->workers){
+        worker.join();
+    }
+}
+
+
+/**
+ * @brief Load (or build) the FASTA indices of all reference files in parallel and list their contigs.
+ *
+ * @return int 0 if all indices were loaded correctly, 1 otherwise.
+ */
+int ReferenceLoader::index_files(){
+
+    int n_files = (int) this->fasta_files.size();
+    std::vector<std::vector<std::string>> names(n_files);
+    std::vector<int> status(n_files, 0);
+    int next_file = 0;
+
+    // every thread loads the index of the next unprocessed file and stores the names of its contigs
+    auto index_worker = [&](){
+        while (true){
+            int i;
+            {
+                std::lock_guard<std::mutex> lock(this->mutex);
+                i = next_file++;
+            }
+            if (i >= n_files){
+                break;
+            }
+
+            faidx_t *fai = fai_load(this->fasta_files[i].c_str());
+            if (fai == NULL){
+                status[i] = 1;
+                continue;
+            }
+            int n_seqs = faidx_nseq(fai);
+            for (int j = 0; j < n_seqs; j++){
+                names[i].push_back(faidx_iseq(fai, j));
+            }
+            fai_destroy(fai);
+        }
+    };
+
+    std::vector<std::thread> indexers;
+    for (int t = 1; t < std::min(this->n_threads, n_files); t++){
+        indexers.push_back(std::thread(index_worker));
+    }
+    index_worker();
+    for (auto &indexer : indexers){
+        indexer.join();
+    }
+
+    // list the contigs in the order of the files and their records
+    std::unordered_set<std::string> seen;
+    for (int i = 0; i < n_files; i++){
+        if (status[i] != 0){
+            std::cerr << "Error opening the FASTA/FAI file \'" << this->fasta_files[i] << "\'." << std::endl;
+            return 1;
+        }
+        for (auto &name : names[i]){
+            // a contig must not be simulated twice
+            if (!seen.insert(name).second){
+                std::cerr << "Error: the contig \'" << name << "\' is contained in multiple reference files." << std::endl;
+                return 1;
+            }
+            Contig contig;
+            contig.file = i;
+            contig.name = name;
+            this->contigs.push_back(contig);
+        }
+    }
+
+    return 0;
+}
+
+
+/**
+ * @brief Worker loop: fetch the next unprocessed contig until all contigs are loaded.
+ *
+ * @details A worker keeps one faidx handle open and only reloads it if the next contig
+ *          is located in a different reference file.
+ */
+void ReferenceLoader::fetch_contigs(){
+
+    faidx_t *fai = NULL;
+    size_t fai_file = 0;
+
+    while (true){
+
+        size_t job;
+        {
+            // load at most one contig per worker ahead of the contig handed out by next()
+            std::unique_lock<std::mutex> lock(this->mutex);
+            this->cond_consumed.wait(lock, [&](){
+                return this->failed || this->next_job >= this->contigs.size() || this->next_job < this->next_contig + this->n_threads;
+            });
+            if (this->failed || this->next_job >= this->contigs.size()){
+                break;
+            }
+            job = this->next_job++;
+        }
+
+        // the contig slots are not reallocated after start(), s.t. workers can fill them without the lock
+        Contig &contig = this->contigs[job];
+
+        if (fai == NULL || fai_file != contig.file){
+            if (fai != NULL){
+                fai_destroy(fai);
+            }
+            fai_file = contig.file;
+            fai = fai_load(this->fasta_files[fai_file].c_str());
+        }
+
+        // copy the sequence outside of the lock, s.t. the workers do not wait for each other
+        char *seq = NULL;
+        std::string sequence;
+        if (fai != NULL){
+            hts_pos_t len;
+            seq = faidx_fetch_seq64(fai, contig.name.c_str(), 0, faidx_seq_len64(fai, contig.name.c_str()), &len);
+            if (seq != NULL){
+                sequence.assign(seq, len);
+                free(seq);
+            }
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(this->mutex);
+            if (seq == NULL){
+                std::cerr << "Error fetching the contig \'" << contig.name << "\' from the FASTA file." << std::endl;
+                this->failed = true;
+            }
+            else{
+                contig.sequence = std::move(sequence);
+                contig.ready = true;
+            }
+        }
+        this->cond_ready.notify_all();
+        this->cond_consumed.notify_all();
+    }
+
+    if (fai != NULL){
+        fai_destroy(fai);
+    }
+}
+
+
+/**
+ * @brief Index the reference files and start the worker threads that load the contigs.
+ *
+ * @return int 0 if the loading was started correctly, 1 otherwise.
+ */
+int ReferenceLoader::start(){
+
+    if (this->verbose){
+        std::cout << "Reading the referece FASTA file..." << std::endl;
+    }
+
+    if (this->index_files() != 0){
+        return 1;
+    }
+
+    // assert that the references are not empty
+    if (this->contigs.empty()){
+        std::cerr << "Error: the reference FASTA file does not contain any sequence." << std::endl;
+        return 1;
+    }
+
+    int n_workers = std::min((size_t) this->n_threads, this->contigs.size());
+    for (int t = 0; t < n_workers; t++){
+        this->workers.push_back(std::thread(&ReferenceLoader::fetch_contigs, this));
+    }
+
+    return 0;
+}
+
+
+/**
+ * @brief Get the next contig in reference order, waiting until it is loaded.
+ *
+ * @param name A string to store the name of the contig.
+ * @param sequence A string to store the sequence of the contig.
+ * @return true if a contig was handed out.
+ * @return false if all contigs were handed out or loading failed.
+ */
+bool ReferenceLoader::next(std::string &name, std::string &sequence){
+
+    std::unique_lock<std::mutex> lock(this->mutex);
+
+    if (this->next_contig >= this->contigs.size()){
+        return false;
+    }
+
+    Contig &contig = this->contigs[this->next_contig];
+    this->cond_ready.wait(lock, [&](){ return contig.ready || this->failed; });
+    if (this->failed){
+        return false;
+    }
+
+    // hand the sequence over to the caller to release the memory of the slot
+    name = contig.name;
+    sequence = std::move(contig.sequence);
+    this->next_contig++;
+
+    // a worker may load the next contig
+    lock.unlock();
+    this->cond_consumed.notify_all();
+
+    return true;
+}
+
+
+/**
+ * @brief Check whether loading a contig failed.
+ *
+ * @return true if a contig could not be loaded.
+ * @return false otherwise.
+ */
+bool ReferenceLoader::has_failed(){
+    std::lock_guard<std::mutex> lock(this->mutex);
+    return this->failed;
+}
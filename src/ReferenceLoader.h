@@ -0,0 +1,61 @@
+#ifndef REFERENCE_LOADER_H
+#define REFERENCE_LOADER_H
+
+#include <string>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <unordered_set>
+#include <iostream>
+#include <cstdlib>
+#include <htslib/faidx.h>
+
+
+/**
+ * @brief A class to load the contigs of one or multiple reference FASTA files in parallel.
+ *
+ * @details Every worker thread fetches whole contigs with its own faidx handle, s.t. plain,
+ *          bgzip compressed (.gzi) and multi FASTA files are decoded concurrently.
+ *          The contigs are handed out in the order of the FASTA files (and of the records
+ *          within a file) as soon as they are ready, i.e. while the remaining contigs are still loading.
+ *          The workers load at most n_threads contigs ahead of the contig handed out last, s.t. the memory
+ *          is bounded by a few contigs instead of the whole reference. A contig name must be unique across the files.
+ */
+class ReferenceLoader{
+    private:
+        struct Contig{
+            size_t file;
+            std::string name;
+            std::string sequence;
+            bool ready = false;
+        };
+        std::vector<std::string> fasta_files;
+        int n_threads;
+        bool verbose;
+        std::vector<Contig> contigs;
+        std::vector<std::thread> workers;
+        std::mutex mutex;
+        std::condition_variable cond_ready;
+        std::condition_variable cond_consumed;  // a contig was handed out (or loading stopped)
+        size_t next_job = 0;        // next contig to be fetched by a worker
+        size_t next_contig = 0;     // next contig to be handed out by next()
+        bool failed = false;
+
+        int index_files();
+        void fetch_contigs();
+
+    public:
+        ReferenceLoader(const std::vector<std::string> &fasta_files, const int n_threads = 1, const bool verbose = false);
+        ~ReferenceLoader();
+        int start();
+        bool next(std::string &name, std::string &sequence);
+        bool has_failed();
+};
+
+
+
+
+
+
+#endif // REFERENCE_LOADER_H
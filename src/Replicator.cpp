@@ -5,47 +5,79 @@
 /**
  * @brief Construct a new Replicator:: Replicator object
  * 
- * @param error_rate the error rate
+ * @param model the error model
+ * @param rng the source of random numbers
  */
-Replicator::Replicator(double error_rate) : error_rate(error_rate) {}
+template <class ErrorModel>
+Replicator<ErrorModel>::Replicator(const ErrorModel &model, RandomSource &rng) : model(model), rng(&rng) {}
 
 
 /**
- * @brief mutate a base
+ * @brief Construct a new Replicator:: Replicator object for the coupled replications only
  * 
- * @param base the base to mutate
- * @return char the mutated base unequal to base
+ * @param model the error model
  */
-char Replicator::mutate(const char base){
+template <class ErrorModel>
+Replicator<ErrorModel>::Replicator(const ErrorModel &model) : model(model) {}
 
-    // vector of possible bases
-    std::vector<char> bases = {'A', 'C', 'G', 'T'};
 
-    // remove the base from the vector of possible bases
-    bases.erase(std::remove(bases.begin(), bases.end(), base), bases.end());
-
-    // assuming std::random::srand() was called before
-    
-    // return a random base from the vector of possible bases
-    return bases[rand() % bases.size()];
+/**
+ * @brief replicate a DNA sequence with errors
+ * 
+ * @param insert the DNA sequence to replicate
+ * @param replicates a vector of strings to store the replicates
+ * @param nb_replications the number of replications
+ * @param nb_replications_variance the variance of the number of replications
+ * @param reps in integer to store the number of replications for that specific insert
+ * @return int 0 if the function was executed correctly, 1 otherwise
+ */
+template <class ErrorModel>
+int Replicator<ErrorModel>::replicate_with_errors(std::string &insert,
+                                      std::vector<std::string> &replicates,
+                                      int nb_replications,
+                                      int nb_replications_variance,
+                                      int &reps){
+    return this->replicate<false>(insert, replicates, nb_replications, nb_replications_variance, reps, NULL);
 }
 
 
 /**
- * @brief replicate a DNA sequence with errors
+ * @brief replicate a DNA sequence with errors and record the ground truth of every replicate
  * 
+ * @details Draws the same random numbers as the untracked replication, s.t. both produce the same replicates.
  * @param insert the DNA sequence to replicate
  * @param replicates a vector of strings to store the replicates
  * @param nb_replications the number of replications
  * @param nb_replications_variance the variance of the number of replications
  * @param reps in integer to store the number of replications for that specific insert
+ * @param truths a vector to store the ground truth of every replicate (parallel to replicates)
  * @return int 0 if the function was executed correctly, 1 otherwise
  */
-int Replicator::replicate_with_errors(std::string &insert,
+template <class ErrorModel>
+int Replicator<ErrorModel>::replicate_with_errors(std::string &insert,
                                       std::vector<std::string> &replicates,
                                       int nb_replications,
                                       int nb_replications_variance,
-                                      int &reps){
+                                      int &reps,
+                                      std::vector<ReplicateTruth> &truths){
+    truths.clear();
+    return this->replicate<true>(insert, replicates, nb_replications, nb_replications_variance, reps, &truths);
+}
+
+
+/**
+ * @brief the replication kernel, specialized on whether the ground truth is recorded
+ * 
+ * @tparam Track whether the ground truth of the replicates is recorded
+ */
+template <class ErrorModel>
+template <bool Track>
+int Replicator<ErrorModel>::replicate(std::string &insert,
+                                      std::vector<std::string> &replicates,
+                                      int nb_replications,
+                                      int nb_replications_variance,
+                                      int &reps,
+                                      std::vector<ReplicateTruth> *truths){
 
     // sanity check: the length of the insert must be at least 1
     if (insert.size() < 1) {
@@ -60,7 +92,7 @@ int Replicator::replicate_with_errors(std::string &insert,
     }
 
     // get a random integer from a normal distribution
-    const unsigned int seed = rand() % UINT_MAX;
+    const unsigned int seed = this->rng->next() % UINT_MAX;
     std::mt19937 gen(seed);     /* Mersenne Twister pseudo-random generator */
     std::normal_distribution<> d(nb_replications, nb_replications_variance);
     int nb_replications_random = d(gen);
@@ -78,6 +110,14 @@ int Replicator::replicate_with_errors(std::string &insert,
     // insert the original sequence into the vector of replicates
     replicates.push_back(insert);
 
+    if (Track){
+        truths->push_back(ReplicateTruth());
+        truths->back().origin.resize(insert.size());
+        for (size_t i = 0; i < insert.size(); ++i){
+            truths->back().origin[i] = i;
+        }
+    }
+
     // generate replicates
     for (int n = 0; n < nb_replications_random; ++n) {
 
@@ -86,40 +126,127 @@ int Replicator::replicate_with_errors(std::string &insert,
         This is to better reflect actual PCR, where the most abundant
         amplicon is the most likely to be replicated.
         */
-        std::string rand_insert = replicates[rand() % replicates.size()];
+        const int parent = this->rng->next() % replicates.size();
+        const std::string &rand_insert = replicates[parent];
         int len_rand_insert = rand_insert.size();
 
-        std::string replicate = "";
+        // the truth of the replicate starts with the errors of its template
+        ReplicateTruth truth;
+        if (Track){
+            const ReplicateTruth &parent_truth = (*truths)[parent];
+            truth.parent = parent;
+            truth.substitutions = parent_truth.substitutions;
+            truth.insertions = parent_truth.insertions;
+            truth.deletions = parent_truth.deletions;
+            truth.origin.reserve(len_rand_insert + len_rand_insert / 8 + 1);
+        }
+
+        // precompute the per base error thresholds of the template (context dependent models only)
+        this->model.prepare(rand_insert);
+
+        std::string replicate;
+        replicate.reserve(len_rand_insert + len_rand_insert / 8 + 1);
 
         for (int i = 0; i < len_rand_insert; ++i) {
-                
-            double rand_num = (double) rand() / RAND_MAX;
-            
+
             // no change in nucleotide
-            if (rand_num > this->error_rate) {
+            if (this->rng->next() > this->model.threshold(i)) {
                 replicate += rand_insert[i];
+                if (Track) truth.origin.push_back((*truths)[parent].origin[i]);
                 continue;
             }
 
-            // change in nucleotide - rand_num will determine whether MM/INS/DEL is introduced
-            rand_num = (double) rand() / RAND_MAX;
-            
-            if (rand_num < 0.8) {           // substitution, add random base
-                replicate += this->mutate(rand_insert[i]);
-            } else if (rand_num < 0.9) {    // insertion, add original base + random base
-                replicate += rand_insert[i];
-                replicate += "ACGT"[rand() % 4];
-            } else {                        // deletion, skip original base
-                continue;
+            // change in nucleotide - the model determines whether MM/INS/DEL is introduced
+            const size_t len_before = replicate.size();
+            this->model.mutate(rand_insert[i], replicate, *this->rng);
+
+            // the number of appended bases tells the error: 1 substitution, 2 insertion, 0 deletion
+            if (Track){
+                const size_t n_appended = replicate.size() - len_before;
+                if (n_appended == 1){
+                    truth.substitutions++;
+                    truth.origin.push_back((*truths)[parent].origin[i]);
+                } else if (n_appended == 2){
+                    truth.insertions++;
+                    truth.origin.push_back((*truths)[parent].origin[i]);
+                    truth.origin.push_back(-1);
+                } else {
+                    truth.deletions++;
+                }
             }
-
         }
 
-        replicates.push_back(replicate);
+        replicates.push_back(std::move(replicate));
+        if (Track){
+            truths->push_back(std::move(truth));
+        }
     }
     
     // we increase the number of replications by 1 to account for the original sequence
     reps++;
 
     return 0;
-}
\ No newline at end of file
+}
+
+
+/**
+ * @brief replicate a DNA sequence with errors from common random numbers
+ * 
+ * @details Every replication selects its template with a draw derived from the stream seed and the index of the
+ *          replication. Every base of the template draws from its own stream, derived from the replication and the
+ *          position of the base: the first draw decides whether the base is replicated with an error, the following
+ *          draws are the error. Hence fewer replications are a prefix of more replications, and the errors of a
+ *          template at a lower error rate are a subset of its errors at a higher rate (the same positions with the
+ *          same errors, whatever happened at the other positions).
+ * @param insert the DNA sequence to replicate
+ * @param nb_replications the number of replications (without the original sequence)
+ * @param stream_seed the seed the streams of the replications are derived from
+ * @param replicates a vector of strings to store the original sequence and the replicates
+ * @return int 0 if the function was executed correctly, 1 otherwise
+ */
+template <class ErrorModel>
+int Replicator<ErrorModel>::replicate_coupled(const std::string &insert,
+                                              int nb_replications,
+                                              uint64_t stream_seed,
+                                              std::vector<std::string> &replicates){
+
+    if (insert.size() < 1) {
+        std::cerr << "Error: the length of the insert must be at least 1." << std::endl;
+        return 1;
+    }
+
+    replicates.clear();
+    replicates.push_back(insert);
+
+    for (int n = 0; n < nb_replications; ++n) {
+
+        const uint64_t replication_seed = RandomSource::derive(stream_seed, (uint64_t) n);
+
+        const std::string &rand_insert = replicates[RandomSource::derive(replication_seed, 0) % replicates.size()];
+        int len_rand_insert = rand_insert.size();
+
+        this->model.prepare(rand_insert);
+
+        std::string replicate;
+        replicate.reserve(len_rand_insert + len_rand_insert / 8 + 1);
+
+        for (int i = 0; i < len_rand_insert; ++i) {
+            SplitMixStream base(RandomSource::derive(replication_seed, (uint64_t) i + 1));
+            if (base.next() > this->model.threshold(i)) {
+                replicate += rand_insert[i];
+            } else {
+                this->model.mutate(rand_insert[i], replicate, base);
+            }
+        }
+
+        replicates.push_back(std::move(replicate));
+    }
+
+    return 0;
+}
+
+
+// explicit instantiations for the available error models
+template class Replicator<SubstitutionModel>;
+template class Replicator<UniformIndelModel>;
+template class Replicator<ContextModel>;
@@ -8,22 +8,64 @@
 #include <iostream>
 #include <climits>
 
+#include "ErrorModel.h"
+#include "RandomSource.h"
 
+
+/**
+ * @brief The ground truth of a replicate: its template and the insert position of every base.
+ *
+ */
+struct ReplicateTruth{
+    int parent = -1;            // index of the replicate that was the template, -1 for the original insert
+    std::vector<int> origin;    // insert position of every base, -1 for inserted bases
+    int substitutions = 0;      // errors injected along the lineage
+    int insertions = 0;
+    int deletions = 0;
+};
+
+
+/**
+ * @brief Class to replicate an insert sequence with errors.
+ * 
+ * @tparam ErrorModel The error model (SubstitutionModel, UniformIndelModel or ContextModel).
+ *         The replication kernel is specialized at compile time on the model,
+ *         s.t. simple models do not pay for the features of the complex ones.
+ */
+template <class ErrorModel>
 class Replicator {
 
 
     private:
         unsigned int seed = time(NULL);
-        double error_rate;
-        char mutate(const char base);
+        ErrorModel model;
+        RandomSource *rng = NULL;
+        template <bool Track>
+        int replicate(std::string &insert,
+                      std::vector<std::string> &replicates,
+                      int nb_replications,
+                      int nb_replications_variance,
+                      int &reps,
+                      std::vector<ReplicateTruth> *truths);
 
     public:
-        Replicator(double error_rate);
+        Replicator(const ErrorModel &model, RandomSource &rng);
+        Replicator(const ErrorModel &model);
         int replicate_with_errors(std::string &insert,
                                   std::vector<std::string> &replicates,
                                   int nb_replications,
                                   int nb_replications_variance,
                                   int &reps);
+        int replicate_with_errors(std::string &insert,
+                                  std::vector<std::string> &replicates,
+                                  int nb_replications,
+                                  int nb_replications_variance,
+                                  int &reps,
+                                  std::vector<ReplicateTruth> &truths);
+        int replicate_coupled(const std::string &insert,
+                              int nb_replications,
+                              uint64_t stream_seed,
+                              std::vector<std::string> &replicates);
 };
 
 
@@ -32,4 +74,4 @@ class Replicator {
 
 
 
-#endif // REPLICATOR_H
\ No newline at end of file
+#endif // REPLICATOR_H
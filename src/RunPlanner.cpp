@@ -0,0 +1,323 @@
+#include "RunPlanner.h"
+
+#include <cmath>
+#include <chrono>
+#include <random>
+#include <iomanip>
+#include <algorithm>
+#include <htslib/faidx.h>
+
+#include "PrimerIndex.h"
+#include "AmpliconGenerator.h"
+#include "RandomSource.h"
+#include "TwoBitFile.h"
+#include "util.h"
+
+
+// one-sided normal quantile of 1 - 1e-6
+static const double UPPER_QUANTILE = 4.753424;
+
+
+/**
+ * @brief A stream buffer that discards its output, used to time the formatting of the amplicons.
+ */
+class NullStreambuf : public std::streambuf{
+    protected:
+        int overflow(int c) override { return c; }
+        std::streamsize xsputn(const char *, std::streamsize n) override { return n; }
+};
+
+
+/**
+ * @brief Get the number of decimal digits of a non-negative number.
+ */
+static int n_digits(double x){
+    return x < 10 ? 1 : (int) std::floor(std::log10(x)) + 1;
+}
+
+
+/**
+ * @brief Get the heap and vector memory of a stored string of a given length (libstdc++ layout).
+ */
+static double string_bytes(double length){
+    return sizeof(std::string) + (length > 15 ? length + 1 + 16 : 0);
+}
+
+
+/**
+ * @brief Construct a new RunPlanner object.
+ *
+ * @param primers A vector of Primer objects.
+ * @param error_profile The error profile of the replications.
+ * @param arguments The command line arguments of the simulation.
+ */
+RunPlanner::RunPlanner(std::vector<Primer> &primers, const ErrorProfile &error_profile, arguments &arguments){
+    this->primers = &primers;
+    this->error_profile = &error_profile;
+    this->args = &arguments;
+}
+
+
+/**
+ * @brief Read the contig lengths from the indices of the references, no sequence is read.
+ *
+ * @details FASTA references are read via their .fai index (created if missing), .2bit references via their record headers.
+ * @param ref_genomes The names of the reference files.
+ * @return int 0 if the function was executed correctly, 1 otherwise.
+ */
+int RunPlanner::read_contig_lengths(const std::vector<std::string> &ref_genomes){
+
+    for (auto &ref_genome : ref_genomes){
+
+        if (TwoBitFile::is_twobit(ref_genome)){
+            TwoBitFile twobit_file;
+            if (twobit_file.open(ref_genome) != 0){
+                return 1;
+            }
+            for (int i = 0; i < twobit_file.n_sequences(); i++){
+                TwoBitSequence sequence;
+                if (twobit_file.get_sequence(i, sequence) != 0){
+                    return 1;
+                }
+                this->contig_lengths[twobit_file.name(i)] = sequence.length();
+            }
+            this->mapped = true;
+            continue;
+        }
+
+        faidx_t *fai = fai_load(ref_genome.c_str());
+        if (fai == NULL){
+            std::cerr << "Error: failed to load the index of \'" << ref_genome << "\'." << std::endl;
+            return 1;
+        }
+        for (int i = 0; i < faidx_nseq(fai); i++){
+            const char *name = faidx_iseq(fai, i);
+            this->contig_lengths[name] = faidx_seq_len64(fai, name);
+        }
+        fai_destroy(fai);
+    }
+
+    return 0;
+}
+
+
+/**
+ * @brief Compute the first two moments of the number of replicates of a template.
+ *
+ * @details The number of replicates is max(1, (int) X) + 1 with X ~ N(mean, sd), as drawn by the Replicator.
+ * @param mean A double to store the expected number of replicates.
+ * @param square A double to store the expected square of the number of replicates.
+ */
+void RunPlanner::replicate_moments(double &mean, double &square){
+
+    const double m = this->args->mean;
+    const double s = this->args->sd;
+
+    if (s <= 0){
+        double reps = std::max(1, (int) m) + 1;
+        mean = reps;
+        square = reps * reps;
+        return;
+    }
+
+    auto cdf = [&](double x){ return 0.5 * std::erfc(-(x - m) / (s * std::sqrt(2.0))); };
+
+    // all draws below 2 are truncated to 1 replication
+    double p = cdf(2.0);
+    mean = 2.0 * p;
+    square = 4.0 * p;
+
+    const int k_max = (int) std::ceil(m + 10 * s) + 1;
+    for (int k = 2; k <= k_max; k++){
+        p = cdf(k + 1.0) - cdf(k);
+        mean += (k + 1.0) * p;
+        square += (k + 1.0) * (k + 1.0) * p;
+    }
+}
+
+
+/**
+ * @brief Time the generation and formatting of amplicons with the given geometry on a random contig.
+ *
+ * @param left_length The length of the left primer.
+ * @param insert_length The length of the insert.
+ * @param right_length The length of the right primer.
+ * @return double The time per amplicon base in seconds, 0 if the calibration failed.
+ */
+double RunPlanner::calibrate(int left_length, int insert_length, int right_length){
+
+    const int amplicon_length = left_length + insert_length + right_length;
+
+    std::mt19937 gen(1);
+    std::string sequence(amplicon_length, 'A');
+    for (auto &base : sequence){
+        base = "ACGT"[gen() & 3];
+    }
+
+    // about 1M amplicon bases per round
+    double reps_mean, reps_square;
+    this->replicate_moments(reps_mean, reps_square);
+    int n_pairs = std::max(1, (int) (1e6 / (reps_mean * amplicon_length)));
+
+    std::vector<Primer> calibration_primers(n_pairs, Primer("calibration", 0, left_length, left_length + insert_length, amplicon_length));
+    PrimerIndex primer_index(calibration_primers);
+
+    arguments calibration_arguments = *this->args;
+    calibration_arguments.dropout = 0.0;
+    calibration_arguments.verbose = false;
+    const bool write_alignment = (std::string(this->args->format) != "fasta");
+
+    NullStreambuf null_buffer;
+    std::ostream null_stream(&null_buffer);
+
+    // the default RandomSource draws from the libc rand() like the simulation, the plan does not simulate afterwards
+    RandomSource rng;
+    double bases = 0;
+    double seconds = 0;
+    auto start = std::chrono::steady_clock::now();
+
+    while (seconds < 0.1){
+        AmpliconGenerator amplicon_generator(calibration_primers, primer_index, *this->error_profile, rng);
+        std::vector<std::string> amplicons;
+        std::vector<AmpliconAlignment> alignments;
+        if (write_alignment){
+            amplicon_generator.record_alignments(alignments);
+        }
+        if (amplicon_generator.generate_amplicons("calibration", sequence, amplicons, calibration_arguments) != 0){
+            return 0;
+        }
+        write_amplicons(null_stream, amplicons, amplicon_generator.get_vec_reps());
+        for (auto &amplicon : amplicons){
+            bases += amplicon.size();
+        }
+        seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    }
+
+    return bases > 0 ? seconds / bases : 0;
+}
+
+
+/**
+ * @brief Predict the resources of the simulation.
+ *
+ * @param plan A RunPlan object to store the predictions.
+ * @return int 0 if the function was executed correctly, 1 otherwise.
+ */
+int RunPlanner::plan(RunPlan &plan){
+
+    const double keep = 1.0 - this->args->dropout;
+    double reps_mean, reps_square;
+    this->replicate_moments(reps_mean, reps_square);
+
+    // number of products of a template: expectation and variance (including the dropout)
+    const double products_mean = keep * reps_mean;
+    const double products_var = keep * reps_square - products_mean * products_mean;
+
+    const bool write_alignment = (std::string(this->args->format) != "fasta");
+
+    double products_variance = 0, bytes_variance = 0, bases = 0, bases_variance = 0, memory_variance = 0;
+    double amplicon_memory = 0;
+    std::vector<int> left_lengths, insert_lengths, right_lengths;
+
+    for (auto &primer : *this->primers){
+
+        if (this->contig_lengths.find(primer.chr) == this->contig_lengths.end()){
+            plan.primer_pairs_missing++;
+            continue;
+        }
+        plan.primer_pairs++;
+
+        const double amplicon_length = primer.end_right - primer.start_left;
+
+        // ">amplicon_<template>_<product>\n<amplicon>\n"
+        const double record_bytes = 13 + n_digits(plan.templates) + n_digits(plan.products) + amplicon_length;
+        double product_memory = string_bytes(amplicon_length);
+        if (write_alignment){
+            product_memory += sizeof(AmpliconAlignment) + 128;
+        }
+
+        plan.templates += keep;
+        plan.products += products_mean;
+        products_variance += products_var;
+        plan.output_bytes += products_mean * record_bytes;
+        bytes_variance += products_var * record_bytes * record_bytes;
+        bases += products_mean * amplicon_length;
+        bases_variance += products_var * amplicon_length * amplicon_length;
+        amplicon_memory += products_mean * product_memory;
+        memory_variance += products_var * product_memory * product_memory;
+
+        if (primer.start_right > primer.end_left){
+            left_lengths.push_back(primer.end_left - primer.start_left);
+            insert_lengths.push_back(primer.start_right - primer.end_left);
+            right_lengths.push_back(primer.end_right - primer.start_right);
+        }
+    }
+
+    const double products_sd = std::sqrt(products_variance);
+    plan.products_upper = plan.products + UPPER_QUANTILE * products_sd;
+    plan.output_bytes_upper = plan.output_bytes + UPPER_QUANTILE * std::sqrt(bytes_variance);
+    const double bases_upper = bases + UPPER_QUANTILE * std::sqrt(bases_variance);
+
+    // the contigs are loaded as a whole, the workers load up to one contig each ahead of the generator
+    std::vector<size_t> lengths;
+    for (auto &contig : this->contig_lengths){
+        lengths.push_back(contig.second);
+    }
+    std::sort(lengths.rbegin(), lengths.rend());
+    double reference_memory = 0;
+    if (!this->mapped){
+        for (size_t i = 0; i < lengths.size() && (int) i <= this->args->threads; i++){
+            reference_memory += string_bytes(lengths[i]);
+        }
+    }
+    const double reference_memory_upper = reference_memory;
+
+    // the vector of amplicons grows by doubling, i.e. holds 1.5 (up to 2) slots per amplicon
+    plan.memory_bytes = amplicon_memory + 0.5 * plan.products * sizeof(std::string) + reference_memory;
+    plan.memory_bytes_upper = amplicon_memory + UPPER_QUANTILE * std::sqrt(memory_variance)
+                            + plan.products_upper * sizeof(std::string) + reference_memory_upper;
+
+    // calibrate with the median amplicon geometry
+    if (!insert_lengths.empty()){
+        size_t median = insert_lengths.size() / 2;
+        std::nth_element(left_lengths.begin(), left_lengths.begin() + median, left_lengths.end());
+        std::nth_element(insert_lengths.begin(), insert_lengths.begin() + median, insert_lengths.end());
+        std::nth_element(right_lengths.begin(), right_lengths.begin() + median, right_lengths.end());
+        plan.seconds_per_base = this->calibrate(left_lengths[median], insert_lengths[median], right_lengths[median]);
+        if (plan.seconds_per_base <= 0){
+            std::cerr << "Error: the calibration of the replication kernel failed." << std::endl;
+            return 1;
+        }
+    }
+    plan.seconds = bases * plan.seconds_per_base;
+    plan.seconds_upper = bases_upper * plan.seconds_per_base;
+
+    return 0;
+}
+
+
+/**
+ * @brief Write a plan as tab separated key value lines.
+ *
+ * @param plan The RunPlan object.
+ * @param out The output stream.
+ */
+void RunPlanner::write_plan(const RunPlan &plan, std::ostream &out){
+
+    out << std::fixed << std::setprecision(0);
+    out << "primer_pairs\t"          << plan.primer_pairs << '\n';
+    out << "primer_pairs_missing\t"  << plan.primer_pairs_missing << '\n';
+    out << "templates\t"             << std::round(plan.templates) << '\n';
+    out << "products\t"              << std::round(plan.products) << '\n';
+    out << "products_upper\t"        << std::ceil(plan.products_upper) << '\n';
+    out << "output_bytes\t"          << std::round(plan.output_bytes) << '\n';
+    out << "output_bytes_upper\t"    << std::ceil(plan.output_bytes_upper) << '\n';
+    out << "memory_bytes\t"          << std::round(plan.memory_bytes) << '\n';
+    out << "memory_bytes_upper\t"    << std::ceil(plan.memory_bytes_upper) << '\n';
+    out << std::scientific << std::setprecision(3);
+    out << "seconds_per_base\t"      << plan.seconds_per_base << '\n';
+    out << std::fixed;
+    out << "seconds\t"               << plan.seconds << '\n';
+    out << "seconds_upper\t"         << plan.seconds_upper << '\n';
+    out.flush();
+}
@@ -0,0 +1,64 @@
+#ifndef RUN_PLANNER_H
+#define RUN_PLANNER_H
+
+#include <string>
+#include <vector>
+#include <iostream>
+#include <unordered_map>
+
+#include "argparser.h"
+#include "Primer.h"
+#include "ErrorProfile.h"
+
+
+/**
+ * @brief The predicted resources of a simulation, as expected values and upper bounds.
+ *
+ */
+struct RunPlan{
+    int primer_pairs = 0;           // primer pairs on a contig of the references
+    int primer_pairs_missing = 0;   // primer pairs on a contig that is not in the references
+    double templates = 0;           // amplicon templates that are not dropped out
+    double products = 0;
+    double products_upper = 0;
+    double output_bytes = 0;        // FASTA output
+    double output_bytes_upper = 0;
+    double memory_bytes = 0;        // peak memory of the amplicons and the references
+    double memory_bytes_upper = 0;
+    double seconds_per_base = 0;    // calibrated generation and formatting time per amplicon base
+    double seconds = 0;
+    double seconds_upper = 0;
+};
+
+
+/**
+ * @brief A class to predict the output size, memory and runtime of a simulation without running it.
+ *
+ * @details The number of replicates of a template is max(1, (int) N(mean, sd)) + 1 and a template is kept
+ *          with the probability 1 - dropout, the predictions are the expectations of these distributions.
+ *          The upper bounds are exceeded with a probability below 1e-6 (normal approximation of the sums).
+ *          The runtime is the expected number of amplicon bases times the time per base of a short
+ *          calibration run of the replication kernel with the actual error profile and amplicon lengths.
+ */
+class RunPlanner{
+    private:
+        std::vector<Primer> *primers;
+        const ErrorProfile *error_profile;
+        arguments *args;
+        std::unordered_map<std::string, size_t> contig_lengths;
+        bool mapped = false;        // .2bit references are memory mapped instead of loaded
+
+        void replicate_moments(double &mean, double &square);
+        double calibrate(int left_length, int insert_length, int right_length);
+
+    public:
+        RunPlanner(std::vector<Primer> &primers, const ErrorProfile &error_profile, arguments &arguments);
+        int read_contig_lengths(const std::vector<std::string> &ref_genomes);
+        int plan(RunPlan &plan);
+        static void write_plan(const RunPlan &plan, std::ostream &out);
+};
+
+
+
+
+#endif // RUN_PLANNER_H
@@ -0,0 +1,317 @@
+#include "ShuffleWriter.h"
+
+#include <queue>
+#include <memory>
+#include <algorithm>
+#include <cstdlib>
+#include <unistd.h>
+
+#include "RandomSource.h"
+#include "util.h"
+
+
+// stream index of the shuffle keys, independent of the streams of the simulation
+static const uint64_t SHUFFLE_STREAM = 0x73687566666c65ULL;
+
+// the runs of a level are merged into one run of the next level before the number of open files becomes a problem
+static const size_t MAX_RUNS = 256;
+
+
+/**
+ * @brief Construct a new ShuffleWriter object.
+ *
+ * @param output_file The name of the output file (NULL for standard output).
+ * @param seed The random seed of the order.
+ * @param strand The strand mode ("forward", "reverse" or "random").
+ * @param max_memory The memory limit of the buffered amplicons in bytes.
+ */
+ShuffleWriter::ShuffleWriter(const char *output_file, const unsigned seed, const std::string &strand, const size_t max_memory){
+    this->output_file = output_file;
+    this->seed = seed;
+    this->strand = strand;
+    this->max_memory = max_memory;
+    const char *tmp_dir = getenv("TMPDIR");
+    this->tmp_dir = (tmp_dir != NULL && tmp_dir[0] != '\0') ? tmp_dir : "/tmp";
+}
+
+
+/**
+ * @brief Destroy the ShuffleWriter object and remove the remaining temporary files.
+ */
+ShuffleWriter::~ShuffleWriter(){
+    for (auto &level : this->levels){
+        for (auto &run : level){
+            unlink(run.c_str());
+        }
+    }
+}
+
+
+/**
+ * @brief Create a temporary file for a run.
+ *
+ * @return std::string The name of the file, empty if it could not be created.
+ */
+std::string ShuffleWriter::temp_file(){
+
+    std::string name = this->tmp_dir + "/amplisim.shuffle.XXXXXX";
+    int fd = mkstemp(&name[0]);
+    if (fd < 0){
+        std::cerr << "Error creating a temporary file in \'" << this->tmp_dir << "\'." << std::endl;
+        return "";
+    }
+    close(fd);
+
+    return name;
+}
+
+
+/**
+ * @brief Orient an amplicon, give it a random key and buffer it, spilling the buffer if it is full.
+ *
+ * @param template_index The index of the amplicon template.
+ * @param amplicon The amplicon (forward strand, reverse complemented in place if needed).
+ * @return int 0 if the function was executed correctly, 1 otherwise.
+ */
+int ShuffleWriter::add(int template_index, std::string &amplicon){
+
+    const uint64_t index = this->n_records++;
+
+    if (this->strand != "forward" && is_reverse_strand(this->strand == "random", this->seed, index)){
+        reverse_complement(amplicon);
+    }
+
+    Record record;
+    record.key = RandomSource::derive(RandomSource::derive(this->seed, SHUFFLE_STREAM), index);
+    record.index = index;
+    record.text = ">amplicon_" + std::to_string(template_index) + "_" + std::to_string(index) + '\n' + amplicon + '\n';
+
+    // the record, its heap allocation and the slack of the vector
+    this->buffer_bytes += 2 * sizeof(Record) + record.text.size() + 32;
+    this->buffer.push_back(std::move(record));
+
+    if (this->buffer_bytes > this->max_memory){
+        return this->spill();
+    }
+
+    return 0;
+}
+
+
+/**
+ * @brief Sort the buffer by key and write it to a temporary run file.
+ *
+ * @return int 0 if the function was executed correctly, 1 otherwise.
+ */
+int ShuffleWriter::spill(){
+
+    std::sort(this->buffer.begin(), this->buffer.end());
+
+    std::string run = this->temp_file();
+    if (run.empty()){
+        return 1;
+    }
+    if (this->levels.empty()){
+        this->levels.resize(1);
+    }
+    this->levels[0].push_back(run);
+
+    std::ofstream out(run, std::ios::binary);
+    for (auto &record : this->buffer){
+        uint32_t length = record.text.size();
+        out.write((const char *) &record.key, sizeof(record.key));
+        out.write((const char *) &record.index, sizeof(record.index));
+        out.write((const char *) &length, sizeof(length));
+        out.write(record.text.data(), length);
+    }
+    out.close();
+    if (out.fail()){
+        std::cerr << "Error writing the temporary file \'" << run << "\'." << std::endl;
+        return 1;
+    }
+
+    this->buffer.clear();
+    this->buffer_bytes = 0;
+
+    // a full level is merged into one run of the next level, the merges cascade like the digits of a counter
+    for (size_t level = 0; level < this->levels.size(); level++){
+        if (this->levels[level].size() >= MAX_RUNS && this->merge_level(level) != 0){
+            return 1;
+        }
+    }
+
+    return 0;
+}
+
+
+/**
+ * @brief Merge the runs of a level into one run of the next level.
+ *
+ * @param level The level of the runs.
+ * @return int 0 if the function was executed correctly, 1 otherwise.
+ */
+int ShuffleWriter::merge_level(size_t level){
+
+    std::string merged = this->temp_file();
+    if (merged.empty()){
+        return 1;
+    }
+    if (this->levels.size() == level + 1){
+        this->levels.resize(level + 2);
+    }
+    this->levels[level + 1].push_back(merged);
+
+    std::ofstream merged_out(merged, std::ios::binary);
+    int ret = this->merge(this->levels[level], merged_out, true);
+    merged_out.close();
+    for (auto &run_file : this->levels[level]){
+        unlink(run_file.c_str());
+    }
+    this->levels[level].clear();
+    if (ret != 0 || merged_out.fail()){
+        std::cerr << "Error writing the temporary file \'" << merged << "\'." << std::endl;
+        return 1;
+    }
+
+    return 0;
+}
+
+
+/**
+ * @brief Get the number of spilled runs of all levels.
+ */
+size_t ShuffleWriter::n_runs() const{
+    size_t n = 0;
+    for (auto &level : this->levels){
+        n += level.size();
+    }
+    return n;
+}
+
+
+/**
+ * @brief Merge sorted run files by key.
+ *
+ * @param run_files The names of the run files.
+ * @param out The output stream.
+ * @param as_run A boolean to write a run file (else the FASTA records).
+ * @return int 0 if the function was executed correctly, 1 otherwise.
+ */
+int ShuffleWriter::merge(const std::vector<std::string> &run_files, std::ostream &out, bool as_run){
+
+    struct RunReader{
+        std::ifstream in;
+        Record record;
+        bool read(){
+            uint32_t length;
+            if (!this->in.read((char *) &this->record.key, sizeof(this->record.key))){
+                return false;
+            }
+            this->in.read((char *) &this->record.index, sizeof(this->record.index));
+            this->in.read((char *) &length, sizeof(length));
+            this->record.text.resize(length);
+            this->in.read(&this->record.text[0], length);
+            return (bool) this->in;
+        }
+    };
+
+    std::vector<std::unique_ptr<RunReader>> readers;
+    for (auto &run_file : run_files){
+        readers.push_back(std::unique_ptr<RunReader>(new RunReader()));
+        readers.back()->in.open(run_file, std::ios::binary);
+        if (!readers.back()->in.is_open()){
+            std::cerr << "Error opening the temporary file \'" << run_file << "\'." << std::endl;
+            return 1;
+        }
+    }
+
+    // min-heap of the runs by their current record
+    auto greater = [&](size_t a, size_t b){ return readers[b]->record < readers[a]->record; };
+    std::priority_queue<size_t, std::vector<size_t>, decltype(greater)> heap(greater);
+    for (size_t i = 0; i < readers.size(); i++){
+        if (readers[i]->read()){
+            heap.push(i);
+        }
+    }
+
+    while (!heap.empty()){
+        size_t i = heap.top();
+        heap.pop();
+        const Record &record = readers[i]->record;
+        if (as_run){
+            uint32_t length = record.text.size();
+            out.write((const char *) &record.key, sizeof(record.key));
+            out.write((const char *) &record.index, sizeof(record.index));
+            out.write((const char *) &length, sizeof(length));
+        }
+        out.write(record.text.data(), record.text.size());
+        if (readers[i]->read()){
+            heap.push(i);
+        }
+    }
+
+    return out.good() ? 0 : 1;
+}
+
+
+/**
+ * @brief Write the shuffled amplicons to the output.
+ *
+ * @details Without spilled runs the buffer is sorted and written directly, else the runs of all levels are merged.
+ * @return int 0 if the function was executed correctly, 1 otherwise.
+ */
+int ShuffleWriter::finish(){
+
+    std::ofstream file;
+    if (this->output_file != NULL){
+        file.open(this->output_file);
+        if (!file.is_open()){
+            std::cerr << "Error opening the output file \'" << this->output_file << "\'." << std::endl;
+            return 1;
+        }
+    }
+    std::ostream &out = (this->output_file != NULL) ? file : std::cout;
+
+    int ret = 0;
+    if (this->n_runs() == 0){
+        std::sort(this->buffer.begin(), this->buffer.end());
+        for (auto &record : this->buffer){
+            out << record.text;
+        }
+        this->buffer.clear();
+    } else {
+        if (!this->buffer.empty()){
+            ret = this->spill();
+        }
+        // the lowest levels are merged up until the final merge opens at most MAX_RUNS files
+        for (size_t level = 0; ret == 0 && level + 1 < this->levels.size() && this->n_runs() > MAX_RUNS; level++){
+            if (!this->levels[level].empty()){
+                ret = this->merge_level(level);
+            }
+        }
+        if (ret == 0){
+            std::vector<std::string> runs;
+            for (auto &level : this->levels){
+                runs.insert(runs.end(), level.begin(), level.end());
+            }
+            ret = this->merge(runs, out, false);
+        }
+        for (auto &level : this->levels){
+            for (auto &run : level){
+                unlink(run.c_str());
+            }
+        }
+        this->levels.clear();
+    }
+
+    out.flush();
+    return (ret == 0 && out.good()) ? 0 : 1;
+}
+
+
+/**
+ * @brief Get the number of amplicons added to the writer.
+ */
+uint64_t ShuffleWriter::size() const{
+    return this->n_records;
+}
@@ -0,0 +1,63 @@
+#ifndef SHUFFLE_WRITER_H
+#define SHUFFLE_WRITER_H
+
+#include <string>
+#include <vector>
+#include <fstream>
+#include <iostream>
+#include <cstdint>
+
+#include "AmpliconGenerator.h"
+
+
+/**
+ * @brief A class to write the amplicons in a uniformly random, seed-deterministic order with bounded memory.
+ *
+ * @details Every amplicon gets a random key derived from the seed and its index. The amplicons are buffered
+ *          while they are generated and the buffer is sorted by key and spilled to a temporary run file
+ *          whenever it exceeds the memory limit. MAX_RUNS runs of a level are merged into one run of the next
+ *          level, s.t. every amplicon is rewritten once per level only, and the runs are merged into the output
+ *          at the end.
+ *          The order only depends on the seed, not on the memory limit.
+ */
+class ShuffleWriter : public AmpliconSink{
+    private:
+        struct Record{
+            uint64_t key;
+            uint64_t index;
+            std::string text;
+            bool operator<(const Record &other) const{
+                return key < other.key || (key == other.key && index < other.index);
+            }
+        };
+        const char *output_file;
+        unsigned seed;
+        std::string strand;
+        size_t max_memory;
+        std::string tmp_dir;
+        std::vector<Record> buffer;
+        size_t buffer_bytes = 0;
+        std::vector<std::vector<std::string>> levels;   // temporary files of the sorted runs, by merge level
+        uint64_t n_records = 0;
+
+        int spill();
+        int merge_level(size_t level);
+        size_t n_runs() const;
+        int merge(const std::vector<std::string> &run_files, std::ostream &out, bool as_run);
+        std::string temp_file();
+
+        ShuffleWriter(const ShuffleWriter &) = delete;
+        ShuffleWriter &operator=(const ShuffleWriter &) = delete;
+
+    public:
+        ShuffleWriter(const char *output_file, const unsigned seed, const std::string &strand, const size_t max_memory);
+        ~ShuffleWriter();
+        int add(int template_index, std::string &amplicon) override;
+        int finish();
+        uint64_t size() const;
+};
+
+
+
+
+#endif // SHUFFLE_WRITER_H
@@ -0,0 +1,685 @@
+#include "SimulationServer.h"
+
+#include <list>
+#include <sstream>
+#include <algorithm>
+#include <iterator>
+#include <cerrno>
+#include <csignal>
+#include <cstring>
+#include <climits>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+
+#include "AmpliconGenerator.h"
+#include "AlignmentWriter.h"
+#include "ErrorProfile.h"
+#include "RandomSource.h"
+#include "ReferenceLoader.h"
+#include "RunPlanner.h"
+#include "TwoBitFile.h"
+#include "util.h"
+
+
+
+/**
+ * @brief A stream buffer that writes to a file descriptor (e.g. a socket).
+ *
+ */
+class FdStreambuf : public std::streambuf{
+    private:
+        int fd;
+        char buffer[1 << 16];
+
+        int flush_buffer(){
+            const char *data = this->pbase();
+            size_t n = this->pptr() - this->pbase();
+            while (n > 0){
+                ssize_t written = write(this->fd, data, n);
+                if (written < 0 && errno == EINTR){
+                    continue;
+                }
+                if (written <= 0){
+                    return -1;
+                }
+                data += written;
+                n -= written;
+            }
+            this->setp(this->buffer, this->buffer + sizeof(this->buffer));
+            return 0;
+        }
+
+    protected:
+        int overflow(int c) override{
+            if (this->flush_buffer() != 0){
+                return EOF;
+            }
+            if (c != EOF){
+                *this->pptr() = (char) c;
+                this->pbump(1);
+            }
+            return c == EOF ? 0 : c;
+        }
+        int sync() override{
+            return this->flush_buffer();
+        }
+
+    public:
+        FdStreambuf(int fd) : fd(fd){
+            this->setp(this->buffer, this->buffer + sizeof(this->buffer));
+        }
+        ~FdStreambuf(){
+            this->flush_buffer();
+        }
+};
+
+
+/**
+ * @brief Write a string completely to a file descriptor.
+ *
+ * @return true if all data was written, false otherwise.
+ */
+static bool write_all(int fd, const std::string &data){
+    FdStreambuf buffer(fd);
+    std::ostream out(&buffer);
+    out << data;
+    out.flush();
+    return out.good();
+}
+
+
+/**
+ * @brief Read a line (without the newline) from a file descriptor.
+ *
+ * @return true if a complete line was read, false otherwise.
+ */
+static bool read_line(int fd, std::string &line){
+    line.clear();
+    char c;
+    while (line.size() < (1 << 20)){
+        ssize_t n = read(fd, &c, 1);
+        if (n < 0 && errno == EINTR){
+            continue;
+        }
+        if (n <= 0){
+            return false;
+        }
+        if (c == '\n'){
+            return true;
+        }
+        line += c;
+    }
+    return false;
+}
+
+
+/**
+ * @brief Get a cache key of a file that changes whenever the file is modified.
+ *
+ * @param file_name The name of the file.
+ * @return std::string The file name with its modification time and size.
+ */
+static std::string file_key(const std::string &file_name){
+    struct stat st;
+    if (stat(file_name.c_str(), &st) != 0){
+        return file_name;
+    }
+    return file_name + ":" + std::to_string((long long) st.st_mtime) + ":" + std::to_string((long long) st.st_size);
+}
+
+
+/**
+ * @brief Get the first option of a request that the server does not support.
+ *
+ * @details The server runs a single simulation into a single output. Only the options of such a simulation are
+ *          supported, every other option (also one added later) is rejected instead of being ignored silently.
+ * @param arguments The arguments of the request.
+ * @return std::string The name of the option or an empty string if all options are supported.
+ */
+static std::string unsupported_option(const arguments &arguments){
+
+    static const int supported[] = {'o', 's', 'm', 'n', 'x', 't', 'e', 'p', 'P', 'S', 'O', 'C', OPT_SHUTDOWN, OPT_PLAN};
+
+    for (auto &key : arguments.given){
+        if (std::find(std::begin(supported), std::end(supported), key) != std::end(supported)){
+            continue;
+        }
+        for (const struct argp_option *option = options; option->name != NULL; option++){
+            if (option->key == key){
+                return std::string("--") + option->name;
+            }
+        }
+    }
+
+    return "";
+}
+
+
+/**
+ * @brief Connect to a Unix domain socket.
+ *
+ * @return int The file descriptor of the connection or -1 on failure.
+ */
+static int connect_socket(const std::string &socket_path){
+
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0){
+        return -1;
+    }
+
+    struct sockaddr_un addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strncpy(addr.sun_path, socket_path.c_str(), sizeof(addr.sun_path) - 1);
+
+    if (connect(fd, (struct sockaddr *) &addr, sizeof(addr)) != 0){
+        close(fd);
+        return -1;
+    }
+
+    return fd;
+}
+
+
+/**
+ * @brief Construct a new SimulationServer object.
+ *
+ * @param socket_path The path of the Unix domain socket.
+ * @param n_workers The number of simulations that run at once.
+ * @param cache_bytes The memory budget of the cached references and primer sets in bytes.
+ */
+SimulationServer::SimulationServer(const std::string &socket_path, const int n_workers, const size_t cache_bytes) : cache(cache_bytes){
+    this->socket_path = socket_path;
+    this->n_workers = n_workers > 0 ? n_workers : 1;
+}
+
+
+/**
+ * @brief Listen on the socket and run the requested simulations until a shutdown request arrives.
+ *
+ * @return int 0 if the server was shut down correctly, 1 otherwise.
+ */
+int SimulationServer::run(){
+
+    // a client that disconnects early must not terminate the server
+    signal(SIGPIPE, SIG_IGN);
+
+    struct sockaddr_un addr;
+    // the socket is bound under a temporary name and renamed once it accepts connections
+    const std::string bind_path = this->socket_path + ".tmp";
+    if (bind_path.size() >= sizeof(addr.sun_path)){
+        std::cerr << "Error: the socket path is too long." << std::endl;
+        return 1;
+    }
+
+    this->listen_fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (this->listen_fd < 0){
+        std::cerr << "Error creating the socket." << std::endl;
+        return 1;
+    }
+
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strncpy(addr.sun_path, bind_path.c_str(), sizeof(addr.sun_path) - 1);
+
+    // remove a stale socket of a previous server
+    unlink(this->socket_path.c_str());
+    unlink(bind_path.c_str());
+
+    // the socket file appears only when the server is ready, s.t. clients can wait for the file
+    if (bind(this->listen_fd, (struct sockaddr *) &addr, sizeof(addr)) != 0 || listen(this->listen_fd, 64) != 0 || rename(bind_path.c_str(), this->socket_path.c_str()) != 0){
+        std::cerr << "Error listening on the socket \'" << this->socket_path << "\'." << std::endl;
+        close(this->listen_fd);
+        unlink(bind_path.c_str());
+        return 1;
+    }
+
+    std::cout << "amplisim server listening on " << this->socket_path << " with " << this->n_workers << " worker(s)..." << std::endl;
+
+    std::vector<std::thread> workers;
+    for (int t = 0; t < this->n_workers; t++){
+        workers.push_back(std::thread(&SimulationServer::serve_connections, this));
+    }
+
+    // accept connections and queue them for the workers
+    while (true){
+        int fd = accept(this->listen_fd, NULL, NULL);
+        if (fd < 0){
+            if (errno == EINTR){
+                continue;
+            }
+            std::cerr << "Error accepting a connection." << std::endl;
+            break;
+        }
+
+        std::lock_guard<std::mutex> lock(this->mutex);
+        if (this->stopped){
+            close(fd);
+            break;
+        }
+        this->connections.push(fd);
+        this->cond_connection.notify_one();
+    }
+
+    this->stop();
+    for (auto &worker : workers){
+        worker.join();
+    }
+
+    close(this->listen_fd);
+    unlink(this->socket_path.c_str());
+
+    std::cout << "amplisim server stopped after " << this->n_jobs << " simulation(s)." << std::endl;
+
+    return 0;
+}
+
+
+/**
+ * @brief Stop accepting connections, the queued connections are still served.
+ */
+void SimulationServer::stop(){
+
+    bool was_stopped;
+    {
+        std::lock_guard<std::mutex> lock(this->mutex);
+        was_stopped = this->stopped;
+        this->stopped = true;
+        this->cond_connection.notify_all();
+    }
+
+    // wake up the accept loop with a connection of its own
+    if (!was_stopped){
+        int fd = connect_socket(this->socket_path);
+        if (fd >= 0){
+            close(fd);
+        }
+    }
+}
+
+
+/**
+ * @brief Worker loop: serve the queued connections until the server is stopped.
+ *
+ * @details An exception of a request is answered with an error, the worker continues with the next connection.
+ */
+void SimulationServer::serve_connections(){
+
+    while (true){
+        int fd;
+        {
+            std::unique_lock<std::mutex> lock(this->mutex);
+            this->cond_connection.wait(lock, [&](){ return !this->connections.empty() || this->stopped; });
+            if (this->connections.empty()){
+                return;
+            }
+            fd = this->connections.front();
+            this->connections.pop();
+        }
+
+        // a failing request must not take down the server and the other requests
+        try{
+            this->handle_request(fd);
+        } catch (const std::exception &exception){
+            std::cerr << "Request failed: " << exception.what() << std::endl;
+            write_all(fd, std::string("ERROR ") + exception.what() + "\n");
+        } catch (...){
+            std::cerr << "Request failed." << std::endl;
+            write_all(fd, "ERROR the request failed\n");
+        }
+        close(fd);
+    }
+}
+
+
+/**
+ * @brief Parse a request, run the simulation and send the response.
+ *
+ * @param fd The file descriptor of the connection.
+ */
+void SimulationServer::handle_request(int fd){
+
+    std::string line;
+    if (!read_line(fd, line)){
+        return;
+    }
+
+    // split the request into the working directory of the client and the command line arguments
+    std::list<std::string> fields;      // a list keeps the strings in place for the parsed arguments
+    std::stringstream ss(line);
+    std::string field;
+    while (std::getline(ss, field, '\t')){
+        fields.push_back(field);
+    }
+    if (fields.empty()){
+        write_all(fd, "ERROR empty request\n");
+        return;
+    }
+    std::string cwd = fields.front();
+    fields.pop_front();
+
+    std::vector<char *> argv;
+    static char program_name[] = "amplisim";
+    argv.push_back(program_name);
+    for (auto &arg : fields){
+        argv.push_back(&arg[0]);
+    }
+    argv.push_back(NULL);
+
+    struct arguments arguments;
+    set_default_arguments(arguments);
+
+    // argp keeps global state while parsing, hence requests are parsed one at a time
+    static std::mutex argp_mutex;
+    error_t parsed;
+    {
+        std::lock_guard<std::mutex> lock(argp_mutex);
+        parsed = argp_parse(&argp, (int) argv.size() - 1, argv.data(), ARGP_SILENT, 0, &arguments);
+    }
+    if (parsed != 0){
+        write_all(fd, "ERROR invalid arguments\n");
+        return;
+    }
+
+    if (arguments.shutdown){
+        write_all(fd, "OK\n");
+        this->stop();
+        return;
+    }
+
+    // resolve the file names relative to the working directory of the client
+    auto resolve = [&](char *&file_name){
+        if (file_name != NULL && file_name[0] != '/'){
+            fields.push_back(cwd + "/" + file_name);
+            file_name = &fields.back()[0];
+        }
+    };
+    for (auto &arg : arguments.args){
+        resolve(arg);
+    }
+    resolve(arguments.output_file);
+    resolve(arguments.profile_file);
+
+    // the server logs per simulation, not per step
+    arguments.verbose = false;
+
+    const std::string option = unsupported_option(arguments);
+    if (!option.empty()){
+        write_all(fd, "ERROR " + option + " is not supported by the server\n");
+        return;
+    }
+
+    if (check_arguments(arguments) != 0){
+        write_all(fd, "ERROR invalid arguments\n");
+        return;
+    }
+
+    int job;
+    {
+        std::lock_guard<std::mutex> lock(this->mutex);
+        job = ++this->n_jobs;
+    }
+
+    std::string error;
+    if (this->simulate(arguments, fd, error) != 0){
+        std::cerr << "Simulation " << job << " failed: " << error << std::endl;
+        write_all(fd, "ERROR " + error + "\n");
+        return;
+    }
+
+    std::cout << "Simulation " << job << " finished.\n" << std::flush;
+}
+
+
+/**
+ * @brief Decode the contigs of .2bit references, s.t. they are cached like FASTA references.
+ *
+ * @param ref_genomes The names of the .2bit files.
+ * @param size A size_t to store the size of the contigs in bytes.
+ * @return The contigs or nullptr if a file could not be read.
+ */
+static std::shared_ptr<std::vector<std::pair<std::string, std::string>>> read_twobit_reference(const std::vector<std::string> &ref_genomes, size_t &size){
+
+    std::shared_ptr<std::vector<std::pair<std::string, std::string>>> contigs = std::make_shared<std::vector<std::pair<std::string, std::string>>>();
+
+    for (auto &ref_genome : ref_genomes){
+        TwoBitFile twobit_file;
+        if (twobit_file.open(ref_genome) != 0){
+            return nullptr;
+        }
+        for (int i = 0; i < twobit_file.n_sequences(); i++){
+            TwoBitSequence sequence;
+            if (twobit_file.get_sequence(i, sequence) != 0){
+                return nullptr;
+            }
+            contigs->push_back(std::make_pair(twobit_file.name(i), sequence.substr(0, sequence.length())));
+            size += twobit_file.name(i).size() + sequence.length();
+        }
+    }
+
+    return contigs;
+}
+
+
+/**
+ * @brief Run a simulation with the cached references and primer sets.
+ *
+ * @param arguments The command line arguments of the simulation.
+ * @param fd The file descriptor of the connection, receives "OK" and the amplicons if no output file is given.
+ * @param error A string to store the error message.
+ * @return int 0 if the simulation was executed correctly, 1 otherwise.
+ */
+int SimulationServer::simulate(arguments &arguments, int fd, std::string &error){
+
+    // if seed unset, use time(NULL)
+    if (arguments.seed == -1){
+        arguments.seed = time(NULL);
+    }
+    unsigned seed = (unsigned) arguments.seed;
+
+    std::vector<std::string> ref_genomes(arguments.args.begin(), arguments.args.end() - 1);
+    std::string bed_file = arguments.args.back();
+
+    // get the primers and their index
+    std::shared_ptr<PrimerSet> primer_set = this->cache.get<PrimerSet>("primers\t" + file_key(bed_file), [&](size_t &size) -> std::shared_ptr<PrimerSet> {
+        std::vector<Primer> primers;
+        if (read_primer(bed_file, primers) != 0){
+            return nullptr;
+        }
+        size = primers.size() * (sizeof(Primer) + 64);
+        return std::make_shared<PrimerSet>(primers);
+    });
+    if (primer_set == nullptr){
+        error = "reading the primer BED file";
+        return 1;
+    }
+
+    // predict the resources of the simulation from the primers and the reference indices only, like the command line
+    if (arguments.plan){
+        ErrorProfile error_profile(arguments.error_rate);
+        if (arguments.profile_file != NULL && read_error_profile(arguments.profile_file, error_profile) != 0){
+            error = "reading the error profile file";
+            return 1;
+        }
+        RunPlanner planner(primer_set->primers, error_profile, arguments);
+        RunPlan plan;
+        if (planner.read_contig_lengths(ref_genomes) != 0 || planner.plan(plan) != 0){
+            error = "planning the simulation";
+            return 1;
+        }
+        FdStreambuf buffer(fd);
+        std::ostream out(&buffer);
+        out << "OK\n";
+        RunPlanner::write_plan(plan, out);
+        return 0;
+    }
+
+    // get the contigs of the references
+    std::string reference_key = "reference";
+    for (auto &ref_genome : ref_genomes){
+        reference_key += "\t" + file_key(ref_genome);
+    }
+    std::shared_ptr<Reference> reference = this->cache.get<Reference>(reference_key, [&](size_t &size) -> std::shared_ptr<Reference> {
+        if (std::all_of(ref_genomes.begin(), ref_genomes.end(), TwoBitFile::is_twobit)){
+            return read_twobit_reference(ref_genomes, size);
+        }
+        ReferenceLoader reference_loader(ref_genomes, arguments.threads);
+        if (reference_loader.start() != 0){
+            return nullptr;
+        }
+        std::shared_ptr<Reference> contigs = std::make_shared<Reference>();
+        std::string chr, sequence;
+        while (reference_loader.next(chr, sequence)){
+            size += chr.size() + sequence.size();
+            contigs->push_back(std::make_pair(chr, std::move(sequence)));
+        }
+        return reference_loader.has_failed() ? nullptr : contigs;
+    });
+    if (reference == nullptr){
+        error = "reading the reference file";
+        return 1;
+    }
+
+    // create the error profile of the replications, optionally from a file
+    ErrorProfile error_profile(arguments.error_rate);
+    if (arguments.profile_file != NULL && read_error_profile(arguments.profile_file, error_profile) != 0){
+        error = "reading the error profile file";
+        return 1;
+    }
+
+    // every simulation draws from its own random number generator
+    RandomSource rng(seed);
+    AmpliconGenerator amplicon_generator(primer_set->primers, primer_set->primer_index, error_profile, rng);
+
+    const bool write_alignment = (std::string(arguments.format) != "fasta");
+    std::vector<AmpliconAlignment> alignments;
+    if (write_alignment){
+        amplicon_generator.record_alignments(alignments);
+    }
+
+    std::vector<std::string> amplicons;
+    for (auto &contig : *reference){
+        if (amplicon_generator.generate_amplicons(contig.first, contig.second, amplicons, arguments) != 0){
+            error = "generating the amplicons";
+            return 1;
+        }
+    }
+    if (amplicons.empty()){
+        error = "no amplicons were generated";
+        return 1;
+    }
+
+    std::vector<int> vec_reps = amplicon_generator.get_vec_reps();
+
+    // the alignments are written by htslib, hence only to a file
+    if (write_alignment){
+        if (arguments.output_file == NULL){
+            error = "the alignment formats require an output file (-o)";
+            return 1;
+        }
+        if (write_alignments(arguments.output_file, arguments.format, ref_genomes, amplicon_generator.get_contigs(), amplicons, vec_reps, alignments, arguments.strand, seed, arguments.threads) != 0){
+            error = "writing the alignments to a file";
+            return 1;
+        }
+        write_all(fd, "OK\n");
+        return 0;
+    }
+
+    if (orient_amplicons(amplicons, arguments.strand, seed, arguments.threads) != 0){
+        error = "orienting the amplicons";
+        return 1;
+    }
+
+    // stream the amplicons to the client
+    if (arguments.output_file == NULL){
+        FdStreambuf buffer(fd);
+        std::ostream out(&buffer);
+        out << "OK\n";
+        write_amplicons(out, amplicons, vec_reps);
+        return 0;
+    }
+
+    int ret;
+    if (arguments.partition != NULL){
+        ret = write_partitioned_amplicons(arguments.output_file, amplicons, vec_reps, amplicon_generator.get_vec_primers(), primer_set->primers, arguments.partition, arguments.threads);
+    } else {
+        ret = write_amplicons(arguments.output_file, amplicons, vec_reps, false);
+    }
+    if (ret != 0){
+        error = "writing the amplicons to a file";
+        return 1;
+    }
+
+    write_all(fd, "OK\n");
+
+    return 0;
+}
+
+
+/**
+ * @brief Send the simulation of the command line to a server and write its response.
+ *
+ * @details The amplicons are written to standard output unless the simulation writes an output file.
+ * @param socket_path The path of the Unix domain socket of the server.
+ * @param argc The number of command line arguments.
+ * @param argv The command line arguments.
+ * @return int 0 if the simulation was executed correctly, 1 otherwise.
+ */
+int send_simulation_request(const std::string &socket_path, int argc, char *argv[]){
+
+    int fd = connect_socket(socket_path);
+    if (fd < 0){
+        std::cerr << "Error connecting to the server on \'" << socket_path << "\'." << std::endl;
+        return 1;
+    }
+
+    char cwd[PATH_MAX];
+    if (getcwd(cwd, sizeof(cwd)) == NULL){
+        std::cerr << "Error getting the working directory." << std::endl;
+        close(fd);
+        return 1;
+    }
+
+    // the server ignores the --connect option of the forwarded command line
+    std::string request = cwd;
+    for (int i = 1; i < argc; i++){
+        request += "\t";
+        request += argv[i];
+    }
+    request += "\n";
+
+    std::string status;
+    if (!write_all(fd, request) || !read_line(fd, status)){
+        std::cerr << "Error communicating with the server." << std::endl;
+        close(fd);
+        return 1;
+    }
+
+    if (status != "OK"){
+        std::cerr << "Error: the server replied \'" << status << "\'." << std::endl;
+        close(fd);
+        return 1;
+    }
+
+    // copy the streamed amplicons to stdout
+    char buffer[1 << 16];
+    ssize_t n;
+    while ((n = read(fd, buffer, sizeof(buffer))) != 0){
+        if (n < 0){
+            if (errno == EINTR){
+                continue;
+            }
+            std::cerr << "Error communicating with the server." << std::endl;
+            close(fd);
+            return 1;
+        }
+        std::cout.write(buffer, n);
+    }
+    std::cout.flush();
+
+    close(fd);
+
+    return 0;
+}
@@ -0,0 +1,168 @@
+#ifndef SIMULATION_SERVER_H
+#define SIMULATION_SERVER_H
+
+#include <string>
+#include <vector>
+#include <list>
+#include <queue>
+#include <memory>
+#include <future>
+#include <functional>
+#include <exception>
+#include <unordered_map>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <iostream>
+
+#include "argparser.h"
+#include "Primer.h"
+#include "PrimerIndex.h"
+
+
+/**
+ * @brief A thread-safe cache of shared objects with a least recently used (LRU) memory budget.
+ *
+ * @details An object is loaded once per key, concurrent requests for the same key wait for the first load.
+ *          Objects of different types share one budget, the type of an object is given by its key.
+ *          Evicted objects stay alive until the last simulation that uses them has finished.
+ */
+class LruCache{
+    private:
+        struct Entry{
+            std::shared_future<std::shared_ptr<void>> value;
+            size_t size;
+            std::list<std::string>::iterator position;
+            const void *loader;     // identifies the request that loads the object
+        };
+        size_t budget;
+        size_t used = 0;
+        std::list<std::string> order;       // keys from the most to the least recently used
+        std::unordered_map<std::string, Entry> entries;
+        std::mutex mutex;
+
+    public:
+        LruCache(size_t budget) : budget(budget) {}
+
+        /**
+         * @brief Get the object of a key, loading it if it is not cached.
+         *
+         * @tparam T The type of the object.
+         * @param key The key of the object.
+         * @param load A function that loads the object and stores its size in bytes, returns nullptr on failure.
+         * @return std::shared_ptr<T> The object or nullptr if loading failed.
+         */
+        template <class T>
+        std::shared_ptr<T> get(const std::string &key, std::function<std::shared_ptr<T>(size_t &)> load){
+
+            std::unique_lock<std::mutex> lock(this->mutex);
+
+            auto it = this->entries.find(key);
+            if (it != this->entries.end()){
+                // move the key to the front of the LRU order
+                this->order.splice(this->order.begin(), this->order, it->second.position);
+                std::shared_future<std::shared_ptr<void>> value = it->second.value;
+                lock.unlock();
+                return std::static_pointer_cast<T>(value.get());
+            }
+
+            std::promise<std::shared_ptr<void>> promise;
+            this->order.push_front(key);
+            Entry entry;
+            entry.value = promise.get_future().share();
+            entry.size = 0;
+            entry.position = this->order.begin();
+            entry.loader = &promise;
+            this->entries[key] = entry;
+            lock.unlock();
+
+            // a throwing load fails like a load that returns nullptr, s.t. the waiting requests are not left hanging
+            size_t size = 0;
+            std::shared_ptr<T> object;
+            try{
+                object = load(size);
+            } catch (const std::exception &exception){
+                std::cerr << "Error loading \'" << key << "\': " << exception.what() << std::endl;
+            } catch (...){
+                std::cerr << "Error loading \'" << key << "\'." << std::endl;
+            }
+
+            lock.lock();
+            it = this->entries.find(key);
+            // the entry may have been evicted (and replaced) while the object was loading
+            if (it != this->entries.end() && it->second.loader == &promise){
+                if (object == nullptr){
+                    this->order.erase(it->second.position);
+                    this->entries.erase(it);
+                } else {
+                    it->second.size = size;
+                    this->used += size;
+
+                    // evict the least recently used objects, but keep the object that was just loaded
+                    while (this->used > this->budget && this->order.back() != key){
+                        auto lru = this->entries.find(this->order.back());
+                        this->used -= lru->second.size;
+                        this->entries.erase(lru);
+                        this->order.pop_back();
+                    }
+                }
+            }
+            lock.unlock();
+
+            promise.set_value(object);
+            return object;
+        }
+};
+
+
+/**
+ * @brief A set of primers with its index, stored together s.t. the index always refers to its own primers.
+ *
+ */
+class PrimerSet{
+    public:
+        std::vector<Primer> primers;
+        PrimerIndex primer_index;
+        PrimerSet(const std::vector<Primer> &primers) : primers(primers), primer_index(this->primers) {}
+};
+
+
+/**
+ * @brief A server that runs simulations requested over a Unix domain socket.
+ *
+ * @details References and primer sets are kept in memory between the simulations (within an LRU budget),
+ *          s.t. a simulation of a known reference and primer set only costs the simulation itself.
+ *          Every request is a single line with the working directory of the client followed by the
+ *          command line arguments of the simulation, all separated by tabs. The response starts with a
+ *          line "OK" or "ERROR <message>", followed by the amplicons if no output file was requested.
+ */
+class SimulationServer{
+    private:
+        typedef std::vector<std::pair<std::string, std::string>> Reference;
+        std::string socket_path;
+        int n_workers;
+        int listen_fd = -1;
+        LruCache cache;
+        std::queue<int> connections;
+        std::mutex mutex;
+        std::condition_variable cond_connection;
+        bool stopped = false;
+        int n_jobs = 0;
+
+        void serve_connections();
+        void handle_request(int fd);
+        int simulate(arguments &arguments, int fd, std::string &error);
+        void stop();
+
+    public:
+        SimulationServer(const std::string &socket_path, const int n_workers = 1, const size_t cache_bytes = (size_t) 4096 << 20);
+        int run();
+};
+
+
+int send_simulation_request(const std::string &socket_path, int argc, char *argv[]);
+
+
+
+
+#endif // SIMULATION_SERVER_H
@@ -0,0 +1,354 @@
+#include "TwoBitFile.h"
+
+#include <cstring>
+#include <cctype>
+#include <algorithm>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+
+static const uint32_t TWOBIT_SIGNATURE = 0x1A412743;
+
+
+/**
+ * @brief Swap the byte order of a 32 bit integer.
+ */
+static inline uint32_t swap32(uint32_t x){
+    return ((x & 0xFF) << 24) | ((x & 0xFF00) << 8) | ((x >> 8) & 0xFF00) | (x >> 24);
+}
+
+
+/**
+ * @brief Get the lookup table that decodes a packed byte into its four bases.
+ */
+static const char (*decode_table())[4]{
+
+    static const struct DecodeTable{
+        char table[256][4];
+        DecodeTable(){
+            for (int byte = 0; byte < 256; byte++){
+                for (int i = 0; i < 4; i++){
+                    this->table[byte][i] = "TCAG"[(byte >> (6 - 2 * i)) & 3];
+                }
+            }
+        }
+    } decode;
+
+    return decode.table;
+}
+
+
+/**
+ * @brief Construct a new empty TwoBitSequence object.
+ */
+TwoBitSequence::TwoBitSequence(){
+    this->packed = NULL;
+    this->dna_size = 0;
+    this->n_blocks = NULL;
+    this->n_block_count = 0;
+    this->mask_blocks = NULL;
+    this->mask_block_count = 0;
+    this->swapped = false;
+}
+
+
+/**
+ * @brief Read the i-th 32 bit integer of an array in the file.
+ */
+uint32_t TwoBitSequence::read32(const uint8_t *p, uint32_t i) const{
+    uint32_t x;
+    memcpy(&x, p + 4 * (size_t) i, 4);
+    return this->swapped ? swap32(x) : x;
+}
+
+
+/**
+ * @brief Get the length of the sequence.
+ */
+size_t TwoBitSequence::length() const{
+    return this->dna_size;
+}
+
+
+/**
+ * @brief Get the length of the sequence.
+ */
+size_t TwoBitSequence::size() const{
+    return this->dna_size;
+}
+
+
+/**
+ * @brief Apply the N blocks or the lower case (mask) blocks to a decoded span.
+ *
+ * @param blocks The start positions followed by the sizes of the blocks (sorted by start position).
+ * @param count The number of blocks.
+ * @param pos The start position of the span in the sequence.
+ * @param span The decoded span.
+ * @param mask A boolean to indicate if the blocks are lower case blocks (else N blocks).
+ */
+void TwoBitSequence::apply_blocks(const uint8_t *blocks, uint32_t count, size_t pos, std::string &span, bool mask) const{
+
+    if (count == 0){
+        return;
+    }
+
+    const uint8_t *sizes = blocks + 4 * (size_t) count;
+    const size_t end = pos + span.size();
+
+    // binary search for the last block that starts at or before pos
+    uint32_t lo = 0, hi = count;
+    while (lo < hi){
+        uint32_t mid = lo + (hi - lo) / 2;
+        if (this->read32(blocks, mid) <= pos){
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    uint32_t b = lo > 0 ? lo - 1 : 0;
+
+    for (; b < count; b++){
+        size_t block_start = this->read32(blocks, b);
+        if (block_start >= end){
+            break;
+        }
+        size_t block_end = block_start + this->read32(sizes, b);
+        size_t from = std::max(block_start, pos);
+        size_t to = std::min(block_end, end);
+        for (size_t i = from; i < to; i++){
+            span[i - pos] = mask ? (char) tolower(span[i - pos]) : 'N';
+        }
+    }
+}
+
+
+/**
+ * @brief Decode a span of the sequence.
+ *
+ * @param pos The start position of the span.
+ * @param len The length of the span (shortened at the end of the sequence).
+ * @return std::string The bases of the span, N blocks as N and masked blocks in lower case.
+ */
+std::string TwoBitSequence::substr(size_t pos, size_t len) const{
+
+    if (pos > this->dna_size){
+        throw std::out_of_range("TwoBitSequence::substr");
+    }
+    len = std::min(len, this->dna_size - pos);
+
+    const char (*table)[4] = decode_table();
+    std::string span(len, 'N');
+
+    size_t i = 0;
+
+    // bases up to the next byte boundary, then four bases per byte, then the remaining bases
+    for (; i < len && ((pos + i) & 3) != 0; i++){
+        span[i] = table[this->packed[(pos + i) >> 2]][(pos + i) & 3];
+    }
+    for (; i + 4 <= len; i += 4){
+        memcpy(&span[i], table[this->packed[(pos + i) >> 2]], 4);
+    }
+    for (; i < len; i++){
+        span[i] = table[this->packed[(pos + i) >> 2]][(pos + i) & 3];
+    }
+
+    this->apply_blocks(this->n_blocks, this->n_block_count, pos, span, false);
+    this->apply_blocks(this->mask_blocks, this->mask_block_count, pos, span, true);
+
+    return span;
+}
+
+
+/**
+ * @brief Construct a new TwoBitFile object.
+ */
+TwoBitFile::TwoBitFile(){
+    this->data = NULL;
+    this->file_size = 0;
+    this->swapped = false;
+}
+
+
+/**
+ * @brief Destroy the TwoBitFile object and unmap the file.
+ */
+TwoBitFile::~TwoBitFile(){
+    if (this->data != NULL){
+        munmap((void *) this->data, this->file_size);
+    }
+}
+
+
+/**
+ * @brief Read a 32 bit integer at an offset of the file.
+ */
+uint32_t TwoBitFile::read32(uint64_t offset) const{
+    uint32_t x;
+    memcpy(&x, this->data + offset, 4);
+    return this->swapped ? swap32(x) : x;
+}
+
+
+/**
+ * @brief Read a 64 bit integer at an offset of the file.
+ */
+uint64_t TwoBitFile::read64(uint64_t offset) const{
+    uint64_t lo = this->read32(offset);
+    uint64_t hi = this->read32(offset + 4);
+    return this->swapped ? (lo << 32) | hi : (hi << 32) | lo;
+}
+
+
+/**
+ * @brief Check whether a file is a .2bit file.
+ *
+ * @param file_name The name of the file.
+ * @return true if the file starts with the .2bit signature (in either byte order).
+ * @return false otherwise.
+ */
+bool TwoBitFile::is_twobit(const std::string &file_name){
+
+    int fd = ::open(file_name.c_str(), O_RDONLY);
+    if (fd < 0){
+        return false;
+    }
+
+    uint32_t signature = 0;
+    ssize_t n = read(fd, &signature, 4);
+    close(fd);
+
+    return n == 4 && (signature == TWOBIT_SIGNATURE || signature == swap32(TWOBIT_SIGNATURE));
+}
+
+
+/**
+ * @brief Map a .2bit file into memory and read its index.
+ *
+ * @param twobit_file The name of the .2bit file.
+ * @return int 0 if the file was opened correctly, 1 otherwise.
+ */
+int TwoBitFile::open(const std::string &twobit_file){
+
+    int fd = ::open(twobit_file.c_str(), O_RDONLY);
+    if (fd < 0){
+        std::cerr << "Error opening the 2bit file \'" << twobit_file << "\'." << std::endl;
+        return 1;
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size < 16){
+        std::cerr << "Error: the 2bit file \'" << twobit_file << "\' is truncated." << std::endl;
+        close(fd);
+        return 1;
+    }
+    this->file_size = st.st_size;
+
+    void *mapped = mmap(NULL, this->file_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (mapped == MAP_FAILED){
+        std::cerr << "Error mapping the 2bit file \'" << twobit_file << "\' into memory." << std::endl;
+        return 1;
+    }
+    this->data = (const uint8_t *) mapped;
+
+    // header: signature, version, sequence count, reserved
+    uint32_t signature;
+    memcpy(&signature, this->data, 4);
+    if (signature != TWOBIT_SIGNATURE && signature != swap32(TWOBIT_SIGNATURE)){
+        std::cerr << "Error: \'" << twobit_file << "\' is not a 2bit file." << std::endl;
+        return 1;
+    }
+    this->swapped = (signature != TWOBIT_SIGNATURE);
+
+    uint32_t version = this->read32(4);
+    uint32_t n_seqs = this->read32(8);
+    if (version > 1){
+        std::cerr << "Error: the 2bit file version " << version << " is not supported." << std::endl;
+        return 1;
+    }
+
+    // index: name size, name, offset (32 bit in version 0, 64 bit in version 1)
+    uint64_t offset = 16;
+    const uint64_t offset_size = (version == 0) ? 4 : 8;
+    for (uint32_t i = 0; i < n_seqs; i++){
+        if (offset + 1 > this->file_size){
+            break;
+        }
+        uint8_t name_size = this->data[offset];
+        if (offset + 1 + name_size + offset_size > this->file_size){
+            break;
+        }
+        this->names.push_back(std::string((const char *) this->data + offset + 1, name_size));
+        offset += 1 + name_size;
+        this->offsets.push_back(version == 0 ? this->read32(offset) : this->read64(offset));
+        offset += offset_size;
+    }
+
+    if (this->names.size() != n_seqs){
+        std::cerr << "Error: the index of the 2bit file \'" << twobit_file << "\' is truncated." << std::endl;
+        return 1;
+    }
+
+    return 0;
+}
+
+
+/**
+ * @brief Get the number of sequences in the file.
+ */
+int TwoBitFile::n_sequences() const{
+    return this->names.size();
+}
+
+
+/**
+ * @brief Get the name of the i-th sequence.
+ */
+const std::string &TwoBitFile::name(int i) const{
+    return this->names[i];
+}
+
+
+/**
+ * @brief Get a view of the i-th sequence, only its record header is read.
+ *
+ * @param i The index of the sequence.
+ * @param sequence A TwoBitSequence object to store the view.
+ * @return int 0 if the record is valid, 1 otherwise.
+ */
+int TwoBitFile::get_sequence(int i, TwoBitSequence &sequence) const{
+
+    // record: dna size, N blocks, mask blocks, reserved, packed bases
+    uint64_t offset = this->offsets[i];
+    if (offset + 8 > this->file_size){
+        std::cerr << "Error: the 2bit record of \'" << this->names[i] << "\' is truncated." << std::endl;
+        return 1;
+    }
+
+    sequence.swapped = this->swapped;
+    sequence.dna_size = this->read32(offset);
+    sequence.n_block_count = this->read32(offset + 4);
+    offset += 8;
+    sequence.n_blocks = this->data + offset;
+    offset += 8 * (uint64_t) sequence.n_block_count;
+
+    if (offset + 4 > this->file_size){
+        std::cerr << "Error: the 2bit record of \'" << this->names[i] << "\' is truncated." << std::endl;
+        return 1;
+    }
+    sequence.mask_block_count = this->read32(offset);
+    offset += 4;
+    sequence.mask_blocks = this->data + offset;
+    offset += 8 * (uint64_t) sequence.mask_block_count + 4;
+
+    sequence.packed = this->data + offset;
+    if (offset + (sequence.dna_size + 3) / 4 > this->file_size){
+        std::cerr << "Error: the 2bit record of \'" << this->names[i] << "\' is truncated." << std::endl;
+        return 1;
+    }
+
+    return 0;
+}
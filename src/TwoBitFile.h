@@ -0,0 +1,65 @@
+#ifndef TWO_BIT_FILE_H
+#define TWO_BIT_FILE_H
+
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <stdexcept>
+#include <iostream>
+
+
+/**
+ * @brief A view of a sequence in a memory mapped .2bit file.
+ *
+ * @details The sequence is decoded on demand, i.e. only the requested spans are converted to text.
+ *          The interface follows std::string, s.t. the AmpliconGenerator can use both.
+ */
+class TwoBitSequence{
+    private:
+        const uint8_t *packed;          // 2 bits per base, T=0 C=1 A=2 G=3, first base in the high bits
+        size_t dna_size;
+        const uint8_t *n_blocks;        // start positions followed by the sizes of the N blocks
+        uint32_t n_block_count;
+        const uint8_t *mask_blocks;     // start positions followed by the sizes of the lower case blocks
+        uint32_t mask_block_count;
+        bool swapped;
+        uint32_t read32(const uint8_t *p, uint32_t i) const;
+        void apply_blocks(const uint8_t *blocks, uint32_t count, size_t pos, std::string &span, bool mask) const;
+        friend class TwoBitFile;
+    public:
+        TwoBitSequence();
+        size_t length() const;
+        size_t size() const;
+        std::string substr(size_t pos, size_t len) const;
+};
+
+
+/**
+ * @brief A class to read the sequences of a UCSC .2bit file via memory mapping.
+ *
+ */
+class TwoBitFile{
+    private:
+        const uint8_t *data;
+        size_t file_size;
+        bool swapped;
+        std::vector<std::string> names;
+        std::vector<uint64_t> offsets;
+        uint32_t read32(uint64_t offset) const;
+        uint64_t read64(uint64_t offset) const;
+        TwoBitFile(const TwoBitFile &) = delete;
+        TwoBitFile &operator=(const TwoBitFile &) = delete;
+    public:
+        TwoBitFile();
+        ~TwoBitFile();
+        int open(const std::string &twobit_file);
+        int n_sequences() const;
+        const std::string &name(int i) const;
+        int get_sequence(int i, TwoBitSequence &sequence) const;
+        static bool is_twobit(const std::string &file_name);
+};
+
+
+
+
+#endif // TWO_BIT_FILE_H
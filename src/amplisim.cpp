@@ -3,6 +3,15 @@
 #include "Primer.h"
 #include "PrimerIndex.h"
 #include "AmpliconGenerator.h"
+#include "ReferenceLoader.h"
+#include "TwoBitFile.h"
+#include "SimulationServer.h"
+#include "AlignmentWriter.h"
+#include "RunPlanner.h"
+#include "ParameterSweep.h"
+#include "ShuffleWriter.h"
+#include "MultiplexRun.h"
+#include "CheckpointRun.h"
 #include "util.h"
 #include "argparser.h"
 
@@ -15,14 +24,25 @@ int main(int argc, char *argv[]){
 
     struct arguments arguments;
     // defaults for CLI parameters
-    arguments.output_file = NULL;
-    arguments.seed = -1;
-    arguments.mean = 20;
-    arguments.sd = 2;
-    arguments.dropout = 0.0;
+    set_default_arguments(arguments);
     
     argp_parse(&argp, argc, argv, 0, 0, &arguments);
 
+    // run as a server that keeps references and primers in memory between simulations
+    if (arguments.serve != NULL){
+        SimulationServer server(arguments.serve, arguments.threads, (size_t) arguments.cache << 20);
+        return server.run();
+    }
+
+    // send the simulation (or the shutdown request) to a running server
+    if (arguments.connect != NULL){
+        return send_simulation_request(arguments.connect, argc, argv);
+    }
+
+    if (check_arguments(arguments) != 0){
+        return 1;
+    }
+
     // if seed unset, use time(NULL)
     if (arguments.seed == -1){
         arguments.seed = time(NULL);
@@ -30,36 +50,45 @@ int main(int argc, char *argv[]){
     unsigned seed = (unsigned) arguments.seed;
     srand(seed);
 
-    std::string ref_genome = arguments.args[0];
-    std::string bed_file   = arguments.args[1];
+    std::vector<std::string> ref_genomes(arguments.args.begin(), arguments.args.end() - 1);
+    std::string bed_file = arguments.args.back();
 
     // print a message to the user
     if (arguments.verbose){
         std::cout << "=== Arguments =====" << std::endl;
-        std::cout << "Reference genome  : " << ref_genome << std::endl;
+        for (auto &ref_genome : ref_genomes){
+            std::cout << "Reference genome  : " << ref_genome << std::endl;
+        }
         std::cout << "Primer BED file   : " << bed_file   << std::endl;
         std::cout << "Output file       : " << arguments.output_file << std::endl;
         std::cout << "Seed              : " << arguments.seed << std::endl;
         std::cout << "Mean #replicates  : " << arguments.mean << std::endl;
         std::cout << "Sd #replicates    : " << arguments.sd << std::endl;
         std::cout << "Dropout likelihood: " << arguments.dropout << std::endl;
+        std::cout << "Threads           : " << arguments.threads << std::endl;
+        std::cout << "Error rate        : " << arguments.error_rate << std::endl;
+        if (arguments.profile_file != NULL){
+            std::cout << "Error profile     : " << arguments.profile_file << std::endl;
+        }
+        if (arguments.partition != NULL){
+            std::cout << "Partition         : " << arguments.partition << std::endl;
+        }
+        std::cout << "Strand            : " << arguments.strand << std::endl;
+        std::cout << "Output format     : " << arguments.format << std::endl;
+        if (arguments.samples != NULL){
+            std::cout << "Sample sheet      : " << arguments.samples << std::endl;
+        }
+        if (arguments.checkpoint > 0){
+            std::cout << "Checkpoint        : " << arguments.checkpoint << " primer pairs" << (arguments.resume ? " (resume)" : "") << std::endl;
+        }
         std::cout << "===================" << std::endl << std::endl;
         std::cout << "\033[32;40mStarting\033[0m amplisim..." << std::endl;
     }
 
-    // create an unordered map to store the names (key) and sequences (value) of the chromosomes
-    std::unordered_map<std::string, std::string> chromosomes;
-
-    int ret = read_reference(ref_genome, chromosomes, arguments.verbose);
-    if (ret != 0){
-        std::cerr << "Error reading the reference FASTA file." << std::endl;
-        return 1;
-    }
-
     // define a vector of Primer objects
     std::vector<Primer> primers;
 
-    ret = read_primer(bed_file, primers, arguments.verbose);
+    int ret = read_primer(bed_file, primers, arguments.verbose);
     if (ret != 0){
         std::cerr << "Error reading the primer BED file." << std::endl;
         return 1;
@@ -68,13 +97,207 @@ int main(int argc, char *argv[]){
     // create a PrimerIndex object
     PrimerIndex primer_index(primers, arguments.verbose);
 
+    // create the error profile of the replications, optionally from a file
+    ErrorProfile error_profile(arguments.error_rate);
+
+    if (arguments.profile_file != NULL){
+        ret = read_error_profile(arguments.profile_file, error_profile, arguments.verbose);
+        if (ret != 0){
+            std::cerr << "Error reading the error profile file." << std::endl;
+            return 1;
+        }
+    }
+
+    // predict the resources of the simulation from the primers and the reference indices only
+    if (arguments.plan){
+        RunPlanner planner(primers, error_profile, arguments);
+        RunPlan plan;
+        if (planner.read_contig_lengths(ref_genomes) != 0 || planner.plan(plan) != 0){
+            std::cerr << "Error planning the simulation." << std::endl;
+            return 1;
+        }
+        RunPlanner::write_plan(plan, std::cout);
+        return 0;
+    }
+
+    // simulate the samples of a sample sheet into one pooled output instead of a single simulation
+    if (arguments.samples != NULL){
+        MultiplexRun multiplex(arguments, error_profile, primers, primer_index);
+        if (multiplex.read_sample_sheet(arguments.samples, ref_genomes) != 0 || multiplex.load_references() != 0 || multiplex.run() != 0){
+            std::cerr << "Error simulating the multiplexed run." << std::endl;
+            return 1;
+        }
+        if (arguments.output_file != NULL){
+            multiplex.write_summary(std::cout);
+        }
+        if (arguments.verbose){
+            std::cout << "\033[32;40mFinished\033[0m with exit status 0." << std::endl;
+        }
+        return 0;
+    }
+
+    // simulate a grid of parameters in one pass instead of a single simulation
+    std::unique_ptr<ParameterSweep> sweep;
+    if (!arguments.sweep.empty()){
+        sweep.reset(new ParameterSweep(arguments, error_profile, primers, primer_index));
+        if (sweep->parse(arguments.sweep) != 0 || sweep->open() != 0){
+            std::cerr << "Error setting up the parameter sweep." << std::endl;
+            return 1;
+        }
+    }
+
+    // write the amplicons in checkpoints instead of collecting them, optionally resuming an interrupted simulation
+    std::unique_ptr<CheckpointRun> checkpoint;
+    if (arguments.checkpoint > 0){
+        checkpoint.reset(new CheckpointRun(arguments, error_profile, primers, primer_index));
+        if (checkpoint->open(arguments.resume) != 0){
+            std::cerr << "Error setting up the checkpoints." << std::endl;
+            return 1;
+        }
+        if (checkpoint->is_finished()){
+            if (arguments.verbose){
+                std::cout << "The checkpointed simulation is already finished." << std::endl;
+            }
+            return 0;
+        }
+    }
+
+    // .2bit references are memory mapped and decoded on demand, FASTA references are loaded in the background
+    int n_twobit = std::count_if(ref_genomes.begin(), ref_genomes.end(), TwoBitFile::is_twobit);
+    if (n_twobit > 0 && n_twobit < (int) ref_genomes.size()){
+        std::cerr << "Error: mixing .2bit and FASTA references is not supported." << std::endl;
+        return 1;
+    }
+
     // create an empty vector of strings to store the amplicons
     std::vector<std::string> amplicons;
 
-    // create an amplicons
-    AmpliconGenerator amplicon_generator(primers, chromosomes, primer_index);
-    ret = amplicon_generator.generate_amplicons(amplicons, arguments);
-    if (ret != 0){
+    // create amplicons for every contig (drawing from the global rand() seeded above)
+    RandomSource rng;
+    AmpliconGenerator amplicon_generator(primers, primer_index, error_profile, rng);
+
+    // shuffle the amplicons while they are generated instead of collecting them
+    ShuffleWriter shuffle_writer(arguments.output_file, seed, arguments.strand, (size_t) arguments.max_memory << 20);
+    if (arguments.shuffle){
+        amplicon_generator.stream_to(shuffle_writer);
+    }
+
+    // the alignment formats need the ground truth of every amplicon
+    const bool write_alignment = (std::string(arguments.format) != "fasta");
+    std::vector<AmpliconAlignment> alignments;
+    if (write_alignment){
+        amplicon_generator.record_alignments(alignments);
+    }
+
+    if (n_twobit > 0){
+
+        for (auto &ref_genome : ref_genomes){
+
+            if (arguments.verbose){
+                std::cout << "Mapping the 2bit file " << ref_genome << "..." << std::endl;
+            }
+
+            TwoBitFile twobit_file;
+            ret = twobit_file.open(ref_genome);
+            if (ret != 0){
+                std::cerr << "Error reading the reference 2bit file." << std::endl;
+                return 1;
+            }
+
+            for (int i = 0; i < twobit_file.n_sequences(); i++){
+                TwoBitSequence sequence;
+                ret = twobit_file.get_sequence(i, sequence);
+                if (ret == 0 && sweep){
+                    ret = sweep->generate(twobit_file.name(i), sequence);
+                } else if (ret == 0 && checkpoint){
+                    ret = checkpoint->generate(twobit_file.name(i), sequence);
+                } else if (ret == 0){
+                    ret = amplicon_generator.generate_amplicons(twobit_file.name(i), sequence, amplicons, arguments);
+                }
+                if (ret != 0){
+                    std::cerr << "Error generating the amplicons." << std::endl;
+                    return 1;
+                }
+            }
+        }
+
+    } else {
+
+        // start loading the reference contigs in the background
+        ReferenceLoader reference_loader(ref_genomes, arguments.threads, arguments.verbose);
+
+        ret = reference_loader.start();
+        if (ret != 0){
+            std::cerr << "Error reading the reference FASTA file." << std::endl;
+            return 1;
+        }
+
+        // create amplicons for every contig as soon as it is loaded
+        std::string chr, sequence;
+        while (reference_loader.next(chr, sequence)){
+            if (sweep){
+                ret = sweep->generate(chr, sequence);
+            } else if (checkpoint){
+                ret = checkpoint->generate(chr, sequence);
+            } else {
+                ret = amplicon_generator.generate_amplicons(chr, sequence, amplicons, arguments);
+            }
+            if (ret != 0){
+                std::cerr << "Error generating the amplicons." << std::endl;
+                return 1;
+            }
+        }
+
+        if (reference_loader.has_failed()){
+            std::cerr << "Error reading the reference FASTA file." << std::endl;
+            return 1;
+        }
+    }
+
+    if (sweep){
+        if (sweep->close() != 0){
+            std::cerr << "Error writing the amplicons to a file." << std::endl;
+            return 1;
+        }
+        sweep->write_summary(std::cout);
+        return 0;
+    }
+
+    if (checkpoint){
+        if (checkpoint->size() == 0){
+            std::cout << "WARNING: No amplicons were generated." << std::endl;
+            std::cerr << "Error generating the amplicons." << std::endl;
+            return 1;
+        }
+        if (checkpoint->finish() != 0){
+            std::cerr << "Error writing the amplicons to a file." << std::endl;
+            return 1;
+        }
+        if (arguments.verbose){
+            std::cout << "\033[32;40mFinished\033[0m with exit status 0." << std::endl;
+        }
+        return 0;
+    }
+
+    if (arguments.shuffle){
+        if (shuffle_writer.size() == 0){
+            std::cout << "WARNING: No amplicons were generated." << std::endl;
+            std::cerr << "Error generating the amplicons." << std::endl;
+            return 1;
+        }
+        if (shuffle_writer.finish() != 0){
+            std::cerr << "Error writing the amplicons to a file." << std::endl;
+            return 1;
+        }
+        if (arguments.verbose){
+            std::cout << "\033[32;40mFinished\033[0m with exit status 0." << std::endl;
+        }
+        return 0;
+    }
+
+    // print a warning if the vector of amplicons is empty and return 1
+    if (amplicons.empty()){
+        std::cout << "WARNING: No amplicons were generated." << std::endl;
         std::cerr << "Error generating the amplicons." << std::endl;
         return 1;
     }
@@ -85,8 +308,24 @@ int main(int argc, char *argv[]){
     assert(vec_reps.size() > 0);
     assert(std::accumulate(vec_reps.begin(), vec_reps.end(), 0) == amplicons.size());
 
-    // use the write_amplicons function to write the amplicons to a file
-    ret = (arguments.output_file == NULL ) ? write_amplicons(NULL, amplicons, vec_reps) : write_amplicons(arguments.output_file, amplicons, vec_reps, false);
+    if (write_alignment){
+        // write the true alignments, the strand of an alignment is a flag instead of a reverse complement
+        ret = write_alignments(arguments.output_file, arguments.format, ref_genomes, amplicon_generator.get_contigs(), amplicons, vec_reps, alignments, arguments.strand, seed, arguments.threads);
+    } else {
+        // reverse complement the amplicons of the reverse strand
+        ret = orient_amplicons(amplicons, arguments.strand, seed, arguments.threads);
+        if (ret != 0){
+            std::cerr << "Error orienting the amplicons." << std::endl;
+            return 1;
+        }
+
+        // use the write_amplicons function to write the amplicons to a file (or one file per partition)
+        if (arguments.partition != NULL){
+            ret = write_partitioned_amplicons(arguments.output_file, amplicons, vec_reps, amplicon_generator.get_vec_primers(), primers, arguments.partition, arguments.threads);
+        } else {
+            ret = (arguments.output_file == NULL ) ? write_amplicons(NULL, amplicons, vec_reps) : write_amplicons(arguments.output_file, amplicons, vec_reps, false);
+        }
+    }
     if (ret != 0){
         std::cerr << "Error writing the amplicons to a file." << std::endl;
         return 1;
@@ -8,11 +8,27 @@
  *       arguments.    
 */
 #include <argp.h>
+#include <vector>
+#include <string>
+#include <iostream>
+#include <cassert>
+#include <cstdlib>
+#include <algorithm>
 
 
 
 static char doc[] = "amplisim -- a program to simulate amplicon sequences from a reference genome";
-static char args_doc[] = "REFERENCE PRIMERS";
+static char args_doc[] = "REFERENCE [REFERENCE...] PRIMERS";
+
+// keys of the options without a short option
+#define OPT_SHUTDOWN 1000
+#define OPT_PLAN 1001
+#define OPT_SWEEP 1002
+#define OPT_SHUFFLE 1003
+#define OPT_MAX_MEMORY 1004
+#define OPT_SAMPLES 1005
+#define OPT_CHECKPOINT 1006
+#define OPT_RESUME 1007
 
 static struct argp_option options[] = {
     {"output",  'o', "FILE", 0, "Output to FILE instead of standard output"},
@@ -20,22 +36,99 @@ static struct argp_option options[] = {
     {"mean",    'm', "INT" , 0, "Set the mean number of replicates per amplicon"},
     {"sd",      'n', "INT" , 0, "Set the standard deviation for the mean number of replicates per amplicon"},
     {"dropout", 'x', "INT" , 0, "Set the likelihood for an amplicon dropout [0,1]"},
+    {"threads", 't', "INT" , 0, "Set the number of threads"},
+    {"error-rate", 'e', "FLOAT", 0, "Set the per base error rate of a replication [0,1]"},
+    {"profile", 'p', "FILE", 0, "Read a position and context dependent error profile from FILE"},
+    {"partition", 'P', "MODE", 0, "Write one FILE per pool, contig or INT amplicons (pool|contig|INT), requires -o"},
+    {"strand", 'S', "MODE", 0, "Set the strand of the amplicons (forward|reverse|random)"},
+    {"format", 'O', "FORMAT", 0, "Set the output format (fasta|sam|bam|cram), alignments carry the true positions and errors"},
+    {"serve", 'L', "SOCKET", 0, "Run as a server on the Unix domain SOCKET that keeps references and primers in memory"},
+    {"connect", 'C', "SOCKET", 0, "Send the simulation to the server on the Unix domain SOCKET"},
+    {"cache", 'M', "INT", 0, "Set the memory budget of the server cache in MB"},
+    {"shutdown", OPT_SHUTDOWN, 0, 0, "Stop the server on the SOCKET given by --connect"},
+    {"sweep", OPT_SWEEP, "KEY=VALUES", 0, "Sweep error-rate, mean, sd or dropout over comma separated VALUES with common random numbers, one FILE per grid point, requires -o (repeatable)"},
+    {"shuffle", OPT_SHUFFLE, 0, 0, "Write the amplicons in a random order (external-memory shuffle, temporary files in TMPDIR)"},
+    {"max-memory", OPT_MAX_MEMORY, "INT", 0, "Set the memory limit of the buffered amplicons of --shuffle in MB"},
+    {"samples", OPT_SAMPLES, "FILE", 0, "Simulate the samples of a sample sheet (name, seed, barcode, references) into one pooled output, bgzip compressed if -o ends with .gz"},
+    {"checkpoint", OPT_CHECKPOINT, "INT", 0, "Write the amplicons in checkpoints of INT primer pairs with a manifest FILE.checkpoint, requires -o and -s"},
+    {"resume", OPT_RESUME, 0, 0, "Resume an interrupted --checkpoint simulation from its manifest"},
+    {"plan", OPT_PLAN, 0, 0, "Predict the number of amplicons, output size, memory and runtime without simulating"},
     {0}
 };
 
 struct arguments {
-    char *args[2];    // reference and primer files
+    std::vector<char*> args;    // reference file(s) followed by the primer file
     char *output_file;
     int seed;
     bool verbose = false;
     int mean;
     int sd;
     double dropout;
+    int threads;
+    double error_rate;
+    char *profile_file;
+    char *partition;
+    char *strand;
+    char *format;
+    char *serve;
+    char *connect;
+    int cache;
+    bool shutdown;
+    bool plan;
+    std::vector<char*> sweep;   // parameter sweeps KEY=VALUES
+    bool shuffle;
+    int max_memory;
+    char *samples;
+    int checkpoint;             // primer pairs per checkpoint (0: no checkpoints)
+    bool resume;
+    std::vector<int> given;     // keys of the options given on the command line
 };
 
+
+/**
+ * @brief Set the default values of the command line arguments.
+ * 
+ * @param arguments The command line arguments.
+ */
+static void set_default_arguments(struct arguments &arguments){
+    arguments.args.clear();
+    arguments.output_file = NULL;
+    arguments.seed = -1;
+    arguments.verbose = false;
+    arguments.mean = 20;
+    arguments.sd = 2;
+    arguments.dropout = 0.0;
+    arguments.threads = 1;
+    arguments.error_rate = 0.01;
+    arguments.profile_file = NULL;
+    arguments.partition = NULL;
+    arguments.strand = (char *) "forward";
+    arguments.format = (char *) "fasta";
+    arguments.serve = NULL;
+    arguments.connect = NULL;
+    arguments.cache = 4096;
+    arguments.shutdown = false;
+    arguments.plan = false;
+    arguments.sweep.clear();
+    arguments.shuffle = false;
+    arguments.max_memory = 1024;
+    arguments.samples = NULL;
+    arguments.checkpoint = 0;
+    arguments.resume = false;
+    arguments.given.clear();
+}
+
 static error_t parse_opt(int key, char *arg, struct argp_state *state){
     struct arguments *arguments = (struct arguments *)state->input;
 
+    // record the given options, s.t. an option can be told apart from its default value
+    for (const struct argp_option *option = options; option->name != NULL; option++){
+        if (option->key == key){
+            arguments->given.push_back(key);
+            break;
+        }
+    }
+
     switch (key){
         case 'o':
             arguments->output_file = arg;
@@ -58,14 +151,69 @@ static error_t parse_opt(int key, char *arg, struct argp_state *state){
             assert(arguments->dropout >= 0);
             assert(arguments->dropout < 1);
             break;
+        case 't':
+            arguments->threads = atoi(arg);
+            assert(arguments->threads > 0);
+            break;
+        case 'e':
+            arguments->error_rate = atof(arg);
+            assert(arguments->error_rate >= 0);
+            assert(arguments->error_rate <= 1);
+            break;
+        case 'p':
+            arguments->profile_file = arg;
+            break;
+        case 'P':
+            arguments->partition = arg;
+            break;
+        case 'S':
+            arguments->strand = arg;
+            break;
+        case 'O':
+            arguments->format = arg;
+            break;
+        case 'L':
+            arguments->serve = arg;
+            break;
+        case 'C':
+            arguments->connect = arg;
+            break;
+        case 'M':
+            arguments->cache = atoi(arg);
+            assert(arguments->cache > 0);
+            break;
+        case OPT_SHUTDOWN:
+            arguments->shutdown = true;
+            break;
+        case OPT_PLAN:
+            arguments->plan = true;
+            break;
+        case OPT_SWEEP:
+            arguments->sweep.push_back(arg);
+            break;
+        case OPT_SHUFFLE:
+            arguments->shuffle = true;
+            break;
+        case OPT_MAX_MEMORY:
+            arguments->max_memory = atoi(arg);
+            assert(arguments->max_memory > 0);
+            break;
+        case OPT_SAMPLES:
+            arguments->samples = arg;
+            break;
+        case OPT_CHECKPOINT:
+            arguments->checkpoint = atoi(arg);
+            assert(arguments->checkpoint > 0);
+            break;
+        case OPT_RESUME:
+            arguments->resume = true;
+            break;
         case ARGP_KEY_ARG:
-            if (state->arg_num >= 2){
-                argp_usage(state);
-            }
-            arguments->args[state->arg_num] = arg;
+            arguments->args.push_back(arg);
             break;
         case ARGP_KEY_END:
-            if (state->arg_num < 2){
+            // the server and the shutdown request do not simulate, hence they need no input files
+            if (state->arg_num < 2 && arguments->serve == NULL && !arguments->shutdown){
                 argp_usage(state);
             }
             break;
@@ -78,6 +226,101 @@ static error_t parse_opt(int key, char *arg, struct argp_state *state){
 static struct argp argp = {options, parse_opt, args_doc, doc};
 
 
+/**
+ * @brief Check if an option was given on the command line.
+ * 
+ * @param arguments The command line arguments.
+ * @param key The key of the option.
+ * @return bool true if the option was given, false otherwise.
+ */
+static bool option_given(const struct arguments &arguments, int key){
+    return std::find(arguments.given.begin(), arguments.given.end(), key) != arguments.given.end();
+}
+
+
+/**
+ * @brief Check the combination of the command line arguments of a simulation.
+ * 
+ * @param arguments The command line arguments.
+ * @return int 0 if the arguments are valid, 1 otherwise.
+ */
+static int check_arguments(const struct arguments &arguments){
+
+    // a simulation needs at least one reference and the primer file
+    if (arguments.args.size() < 2){
+        std::cerr << "Error: a simulation requires a REFERENCE and a PRIMERS file." << std::endl;
+        return 1;
+    }
+
+    // partitioned output requires an output file name
+    if (arguments.partition != NULL && arguments.output_file == NULL){
+        std::cerr << "Error: the partitioned output (-P) requires an output file (-o)." << std::endl;
+        return 1;
+    }
+
+    std::string strand = arguments.strand;
+    if (strand != "forward" && strand != "reverse" && strand != "random"){
+        std::cerr << "Error: the strand (-S) must be forward, reverse or random." << std::endl;
+        return 1;
+    }
+
+    std::string format = arguments.format;
+    if (format != "fasta" && format != "sam" && format != "bam" && format != "cram"){
+        std::cerr << "Error: the output format (-O) must be fasta, sam, bam or cram." << std::endl;
+        return 1;
+    }
+
+    // a sweep writes one file per grid point
+    if (!arguments.sweep.empty() && (arguments.output_file == NULL || arguments.partition != NULL || format != "fasta")){
+        std::cerr << "Error: the sweep (--sweep) requires an output file (-o) in the fasta format without partitions." << std::endl;
+        return 1;
+    }
+
+    // the shuffled output is a single FASTA file
+    if (arguments.shuffle && (arguments.partition != NULL || !arguments.sweep.empty() || format != "fasta")){
+        std::cerr << "Error: the shuffled output (--shuffle) requires the fasta format without partitions or sweeps." << std::endl;
+        return 1;
+    }
+
+    // the plan predicts a single FASTA or alignment file that is written from memory at the end
+    if (arguments.plan && (arguments.partition != NULL || !arguments.sweep.empty() || arguments.shuffle || arguments.checkpoint > 0)){
+        std::cerr << "Error: the plan (--plan) does not support partitions, sweeps, shuffling or checkpoints." << std::endl;
+        return 1;
+    }
+
+    // the memory limit only applies to the shuffle
+    if (option_given(arguments, OPT_MAX_MEMORY) && !arguments.shuffle){
+        std::cerr << "Error: the memory limit (--max-memory) requires the shuffled output (--shuffle)." << std::endl;
+        return 1;
+    }
+
+    // the samples are pooled into a single FASTA file
+    if (arguments.samples != NULL && (arguments.partition != NULL || !arguments.sweep.empty() || arguments.shuffle || arguments.plan || format != "fasta")){
+        std::cerr << "Error: the multiplexed run (--samples) requires the fasta format without partitions, sweeps, shuffling or plans." << std::endl;
+        return 1;
+    }
+
+    // a checkpointed simulation streams a single FASTA file with a fixed seed
+    if (arguments.checkpoint > 0 && (arguments.output_file == NULL || arguments.seed == -1 || arguments.partition != NULL || !arguments.sweep.empty() || arguments.shuffle || arguments.samples != NULL || format != "fasta")){
+        std::cerr << "Error: the checkpoints (--checkpoint) require an output file (-o) and a seed (-s) in the fasta format without partitions, sweeps, shuffling or samples." << std::endl;
+        return 1;
+    }
+
+    if (arguments.resume && arguments.checkpoint == 0){
+        std::cerr << "Error: resuming (--resume) requires the checkpoints (--checkpoint)." << std::endl;
+        return 1;
+    }
+
+    // the alignment formats are written as a single file
+    if (format != "fasta" && arguments.partition != NULL){
+        std::cerr << "Error: the partitioned output (-P) requires the fasta format." << std::endl;
+        return 1;
+    }
+
+    return 0;
+}
+
+
 
 
 
@@ -8,100 +8,169 @@
 #include <sstream>
 #include <fstream>
 #include <cassert>
-#include <htslib/faidx.h>
+#include <thread>
+#include <mutex>
+#include <algorithm>
+#include <cctype>
+#include <cstdint>
+#include <cstdlib>
+#include <cerrno>
+#include <climits>
 
 #include "Primer.h"
+#include "ErrorProfile.h"
 
 
 /**
- * @brief Reverse complement a sequence.
+ * @brief Get the lookup table of complementary nucleotides.
  * 
- * @param seq The sequence to reverse complement.
- * @return std::string The reverse complement of the sequence.
+ * @details Covers the IUPAC nucleotide codes in upper and lower case (A/T, C/G, U/A, R/Y, K/M, B/V, D/H, S, W, N).
+ *          All other characters are their own complement.
+ * @return const unsigned char* A table of 256 characters.
  */
-static std::string reverse_complement(std::string seq){
-
-    // create a string to store the reverse complement
-    std::string rev_comp;
-
-    // loop over the sequence in reverse order
-    for (int i = seq.size() - 1; i >= 0; i--){
-
-        // check if the current character is a nucleotide
-        if (seq[i] == 'A' || seq[i] == 'a'){
-            rev_comp += 'T';
-        } else if (seq[i] == 'T' || seq[i] == 't'){
-            rev_comp += 'A';
-        } else if (seq[i] == 'C' || seq[i] == 'c'){
-            rev_comp += 'G';
-        } else if (seq[i] == 'G' || seq[i] == 'g'){
-            rev_comp += 'C';
-        } else {
-            // print a warning message to the user if the current character is not a nucleotide
-            std::cerr << "Warning: the sequence contains non-nucleotide characters." << std::endl;
-            // if the current character is not a nucleotide, return an empty string
-            return "N";
+static const unsigned char *complement_table(){
+
+    static const struct ComplementTable{
+        unsigned char table[256];
+        ComplementTable(){
+            for (int c = 0; c < 256; c++){
+                this->table[c] = (unsigned char) c;
+            }
+            const char *pairs[] = {"AT", "CG", "UA", "RY", "KM", "BV", "DH", "SS", "WW", "NN"};
+            for (auto &pair : pairs){
+                for (int lower = 0; lower < 2; lower++){
+                    unsigned char a = lower ? tolower(pair[0]) : pair[0];
+                    unsigned char b = lower ? tolower(pair[1]) : pair[1];
+                    this->table[a] = b;
+                    if (a != 'U' && a != 'u'){
+                        this->table[b] = a;
+                    }
+                }
+            }
         }
-    }
+    } complement;
 
-    return rev_comp;
+    return complement.table;
 }
 
 
 /**
- * @brief Read a reference FASTA file and store the names and sequences in vectors.
+ * @brief Reverse complement a sequence in place.
  * 
- * @param fasta_file The name of the FASTA file.
- * @param chromosomes An unordered map to store the names (key) and sequences (value) of the chromosomes.
- * @param verbose A boolean to indicate if the function should print messages to the user.
- * @return int 0 if the function was executed correctly, 1 otherwise.
+ * @param seq The sequence to reverse complement (IUPAC codes, the case is kept).
  */
-static int read_reference(std::string fasta_ref_gemome, std::unordered_map<std::string, std::string> &chromosomes, const bool verbose = false){
-
-    // open the fasta file
-    faidx_t *fai = fai_load(fasta_ref_gemome.c_str());
-
-    // check if the file was opened correctly
-    if (fai == NULL){
-        std::cerr << "Error opening the FASTA/FAI file." << std::endl;
-        return 1;
+static void reverse_complement(std::string &seq){
+
+    const unsigned char *table = complement_table();
+
+    // swap and complement the bases from both ends towards the middle
+    size_t i = 0, j = seq.size();
+    while (i + 1 < j){
+        --j;
+        char c = seq[i];
+        seq[i] = table[(unsigned char) seq[j]];
+        seq[j] = table[(unsigned char) c];
+        ++i;
     }
 
-    if (verbose){
-        std::cout << "Reading the referece FASTA file..." << std::endl;
+    // complement the central base of an odd length sequence
+    if (i < j){
+        seq[i] = table[(unsigned char) seq[i]];
     }
+}
 
-    // get the number of sequences in the fasta file
-    int n_seqs = faidx_nseq(fai);
 
-    // from the multi FASTA file get all the chromosome names and sequences and store them in vectors
-    for (int i = 0; i < n_seqs; i++){
+/**
+ * @brief Decide whether an amplicon is on the reverse strand.
+ * 
+ * @details In random mode every amplicon is reversed with a probability of 50%. The decision is a
+ *          hash of the seed and the amplicon index, s.t. it does not consume the random numbers of the
+ *          simulation and the amplicons can be processed by multiple threads in any order.
+ * @param random A boolean to indicate the random mode (else every amplicon is reversed).
+ * @param seed The random seed.
+ * @param idx The index of the amplicon.
+ * @return true if the amplicon is on the reverse strand.
+ * @return false otherwise.
+ */
+static inline bool is_reverse_strand(const bool random, const unsigned seed, const size_t idx){
 
-        // get the chromosome name
-        const char *name = faidx_iseq(fai, i);
+    if (!random){
+        return true;
+    }
 
-        // get chromosome end position
-        int end = faidx_seq_len(fai, name);
+    // splitmix64 finalizer of the seed and the amplicon index
+    uint64_t z = ((uint64_t) seed << 32) + idx + 0x9E3779B97F4A7C15ULL;
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+    z = z ^ (z >> 31);
+    return (z & 1) == 0;
+}
 
-        // get the chromosome sequence
-        int len;
-        char *seq = faidx_fetch_seq(fai, name, 0, end, &len);
 
-        // store the chromosome name and sequence in the unordered map
-        chromosomes[name] = seq;
+/**
+ * @brief Orient the amplicons according to the strand mode.
+ * 
+ * @details The strand of an amplicon is given by is_reverse_strand.
+ * @param amplicons A vector of strings containing the amplicons (reverse complemented in place).
+ * @param strand The strand mode ("forward", "reverse" or "random").
+ * @param seed The random seed.
+ * @param n_threads The number of threads.
+ * @return int 0 if the function was executed correctly, 1 otherwise.
+ */
+static int orient_amplicons(std::vector<std::string> &amplicons, const std::string &strand, const unsigned seed, const int n_threads = 1){
 
-        // free the memory
-        free(seq);
+    if (strand != "forward" && strand != "reverse" && strand != "random"){
+        std::cerr << "Error: the strand must be forward, reverse or random." << std::endl;
+        return 1;
     }
 
-    // close the fasta file
-    fai_destroy(fai);
+    if (strand == "forward"){
+        return 0;
+    }
+
+    const bool random = (strand == "random");
+    const size_t n_amplicons = amplicons.size();
 
-    // assert that the chromosomes map is not empty
-    assert(!chromosomes.empty());
+    // every thread orients a contiguous block of amplicons
+    auto orient_block = [&](size_t begin, size_t end){
+        for (size_t idx = begin; idx < end; ++idx){
+            if (is_reverse_strand(random, seed, idx)){
+                reverse_complement(amplicons[idx]);
+            }
+        }
+    };
+
+    size_t n_workers = std::max(1, std::min(n_threads, (int) n_amplicons));
+    size_t block = (n_amplicons + n_workers - 1) / n_workers;
+    std::vector<std::thread> workers;
+    for (size_t t = 1; t < n_workers; t++){
+        workers.push_back(std::thread(orient_block, std::min(t * block, n_amplicons), std::min((t + 1) * block, n_amplicons)));
+    }
+    orient_block(0, std::min(block, n_amplicons));
+    for (auto &worker : workers){
+        worker.join();
+    }
 
     return 0;
+}
+
 
+/**
+ * @brief Parse a non-negative position of a BED file.
+ *
+ * @param field The field of the BED file.
+ * @param position An int to store the position.
+ * @return bool true if the field is a valid position, false otherwise.
+ */
+static bool parse_bed_position(const std::string &field, int &position){
+    char *end;
+    errno = 0;
+    long value = strtol(field.c_str(), &end, 10);
+    if (field.empty() || *end != '\0' || errno != 0 || value < 0 || value > INT_MAX){
+        return false;
+    }
+    position = (int) value;
+    return true;
 }
 
 
@@ -111,7 +180,7 @@ static int read_reference(std::string fasta_ref_gemome, std::unordered_map<std::
  * @param bed_file The name of the BED file.
  * @param primers A vector of Primer objects to store the information of the primers.
  * @param verbose A boolean to indicate if the function should print messages to the user.
- * @return int 0 if the function was executed correctly, 1 otherwise.
+ * @return int 0 if the function was executed correctly, 1 otherwise (also if a line has less than three fields or invalid positions).
  */
 static int read_primer(std::string bed_file, std::vector<Primer> &primers, const bool verbose = false){
 
@@ -137,7 +206,7 @@ static int read_primer(std::string bed_file, std::vector<Primer> &primers, const
        Every two lines (odd line): create a Primer object and store it in the vector
     */
     int i = 0;
-    std::string chrom;
+    std::string chrom, pool;
     int left_start, left_end, right_start, right_end;
 
     while (std::getline(bed, line) && !line.empty()){       // avoid getting trapped in eof artefacts (empty lines)
@@ -150,6 +219,13 @@ static int read_primer(std::string bed_file, std::vector<Primer> &primers, const
             fields.push_back(field);
         }
 
+        // every line needs the chromosome, the start and the end of the primer
+        int start, end;
+        if (fields.size() < 3 || !parse_bed_position(fields[1], start) || !parse_bed_position(fields[2], end)){
+            std::cerr << "Error: line " << i + 1 << " of the BED file is not of the form CHROM START END." << std::endl;
+            return 1;
+        }
+
         // check if the line number is odd or even
         if (i & 1){
             // if the last bit of i is set, we are reading the second line of the primer
@@ -158,19 +234,21 @@ static int read_primer(std::string bed_file, std::vector<Primer> &primers, const
                 std::cerr << "Error: the chromosome of the left and right primer are not the same." << std::endl;
                 return 1;
             }            
-            right_start = std::stoi(fields[1]);
-            right_end = std::stoi(fields[2]);
+            right_start = start;
+            right_end = end;
 
             // create a Primer object and store it in the vector
-            Primer p(chrom, left_start, left_end, right_start, right_end);
+            Primer p(chrom, left_start, left_end, right_start, right_end, pool);
             primers.push_back(p);
 
         } else {
             // if the last bit of i is not set, we are reading the first line of the primer
             // store the information of the left primer
             chrom = fields[0];
-            left_start = std::stoi(fields[1]);
-            left_end = std::stoi(fields[2]);
+            left_start = start;
+            left_end = end;
+            // the optional fifth column holds the primer pool
+            pool = fields.size() > 4 ? fields[4] : "";
         }
 
         // increase the line counter
@@ -186,33 +264,111 @@ static int read_primer(std::string bed_file, std::vector<Primer> &primers, const
 
 
 /**
- * @brief Write the amplicons to a FASTA file or COUT.
+ * @brief Read an error profile file and store the information in an ErrorProfile object.
  * 
- * @param amplicons_fasta The name of the FASTA file.
- * @param amplicons A vector of strings containing the amplicons.
- * @param vec_reps A vector of integers containing the number of replications for each amplicon.
- * @param write_to_stdout A boolean to indicate if the amplicons should be written to stdout.
+ * @details The file is a whitespace separated textfile with one setting per line, lines starting with # are ignored:
+ *          rate <rate>                         per base error rate
+ *          indel <insertion> <deletion>        fractions of errors that are insertions and deletions
+ *          position <pos> <rate>               per base error rate at position pos of the insert (0-based)
+ *          homopolymer <length> <rate>         per base error rate within homopolymers of at least length bases
+ *          substitution <base> <A> <C> <G> <T> weights of the substitutions of base by A, C, G and T
+ *          The rates must be within [0,1] and the weights must not be negative.
+ * @param profile_file The name of the error profile file.
+ * @param profile An ErrorProfile object to store the settings (settings that are not in the file are kept).
+ * @param verbose A boolean to indicate if the function should print messages to the user.
  * @return int 0 if the function was executed correctly, 1 otherwise.
  */
-static int write_amplicons(const char*                    amplicons_fasta,
-                           const std::vector<std::string> &amplicons,
-                           const std::vector<int>         &vec_reps,
-                           const bool                     write_to_stdout = true){
+static int read_error_profile(std::string profile_file, ErrorProfile &profile, const bool verbose = false){
 
-    // open the FASTA file
-    std::ofstream fasta;
+    // open the profile file
+    std::ifstream in(profile_file);
+
+    // check if the file was opened correctly
+    if (!in.is_open()){
+        std::cerr << "Error opening the error profile file." << std::endl;
+        return 1;
+    }
+
+    if (verbose){
+        std::cout << "Reading the error profile file..." << std::endl;
+    }
+
+    std::string line;
+    int line_number = 0;
+    while (std::getline(in, line)){
+
+        line_number++;
+        std::stringstream ss(line);
+        std::string key;
+        if (!(ss >> key) || key[0] == '#'){
+            continue;
+        }
 
-    if (!write_to_stdout){
-        fasta = std::ofstream(amplicons_fasta);
+        bool ok = true;
+        if (key == "rate"){
+            ok = (bool) (ss >> profile.rate);
+        } else if (key == "indel"){
+            ok = (bool) (ss >> profile.insertion >> profile.deletion);
+        } else if (key == "position"){
+            int pos;
+            double rate;
+            ok = (bool) (ss >> pos >> rate) && pos >= 0 && rate >= 0 && rate <= 1;
+            if (ok){
+                if ((int) profile.position_rates.size() <= pos){
+                    profile.position_rates.resize(pos + 1, -1.0);
+                }
+                profile.position_rates[pos] = rate;
+            }
+        } else if (key == "homopolymer"){
+            int length;
+            double rate;
+            ok = (bool) (ss >> length >> rate) && length > 0 && rate >= 0 && rate <= 1;
+            if (ok){
+                profile.homopolymer_rates.push_back(std::make_pair(length, rate));
+            }
+        } else if (key == "substitution"){
+            std::string base;
+            double weights[4];
+            ok = (bool) (ss >> base >> weights[0] >> weights[1] >> weights[2] >> weights[3]);
+            size_t from = std::string("ACGT").find(base);
+            ok = ok && base.size() == 1 && from != std::string::npos;
+            ok = ok && std::all_of(weights, weights + 4, [](double weight){ return weight >= 0; });
+            if (ok){
+                std::copy(weights, weights + 4, profile.substitution_matrix[from]);
+                profile.has_substitution_matrix = true;
+            }
+        } else {
+            ok = false;
+        }
 
-        if (!fasta.is_open()){
-            std::cerr << "Error opening the FASTA file." << std::endl;
+        if (!ok){
+            std::cerr << "Error: invalid line " << line_number << " in the error profile file." << std::endl;
             return 1;
         }
+    }
 
-        std::cout << "Writing the amplicons to a FASTA file..." << std::endl;
+    // check that the rates are valid probabilities
+    if (profile.rate < 0 || profile.rate > 1 || profile.insertion < 0 || profile.deletion < 0 || profile.insertion + profile.deletion > 1){
+        std::cerr << "Error: the error rates of the profile must be within [0,1]." << std::endl;
+        return 1;
     }
 
+    return 0;
+}
+
+
+/**
+ * @brief Write the amplicons to an output stream in FASTA format.
+ * 
+ * @param out The output stream.
+ * @param amplicons A vector of strings containing the amplicons.
+ * @param vec_reps A vector of integers containing the number of replications for each amplicon.
+ * @return int 0 if the function was executed correctly, 1 otherwise.
+ */
+static int write_amplicons(std::ostream                   &out,
+                           const std::vector<std::string> &amplicons,
+                           const std::vector<int>         &vec_reps){
+
     // cast the size of the amplicons vector an int
     int n_amplicons = amplicons.size();
 
@@ -220,17 +376,11 @@ static int write_amplicons(const char*                    amplicons_fasta,
     int idx_insert = 0;
     int count_per_insert = 1;
 
-    // loop over the amplicons and write them to the FASTA file
+    // loop over the amplicons and write them to the output stream
     for (int idx_amplicon = 0; idx_amplicon < n_amplicons; ++idx_amplicon){
 
-        if (!write_to_stdout){
-            fasta << ">amplicon_" << idx_insert << "_" << idx_amplicon << std::endl;
-            fasta << amplicons[idx_amplicon] << std::endl;
-        }
-        else{
-            std::cout << ">amplicon_" << idx_insert << "_" << idx_amplicon << std::endl;
-            std::cout << amplicons[idx_amplicon] << std::endl;
-        }
+        out << ">amplicon_" << idx_insert << "_" << idx_amplicon << '\n';
+        out << amplicons[idx_amplicon] << '\n';
 
         // check if the current amplicon is the last one of the current insert
         if (count_per_insert == vec_reps[idx_insert]){
@@ -243,12 +393,223 @@ static int write_amplicons(const char*                    amplicons_fasta,
         }
     }
 
-    if (!write_to_stdout){
-        // close the FASTA file
-        fasta.close();
+    out.flush();
+
+    return out.good() ? 0 : 1;
+}
+
+
+/**
+ * @brief Write the amplicons to a FASTA file or COUT.
+ * 
+ * @param amplicons_fasta The name of the FASTA file.
+ * @param amplicons A vector of strings containing the amplicons.
+ * @param vec_reps A vector of integers containing the number of replications for each amplicon.
+ * @param write_to_stdout A boolean to indicate if the amplicons should be written to stdout.
+ * @return int 0 if the function was executed correctly, 1 otherwise.
+ */
+static int write_amplicons(const char*                    amplicons_fasta,
+                           const std::vector<std::string> &amplicons,
+                           const std::vector<int>         &vec_reps,
+                           const bool                     write_to_stdout = true){
+
+    if (write_to_stdout){
+        return write_amplicons(std::cout, amplicons, vec_reps);
+    }
+
+    // open the FASTA file
+    std::ofstream fasta(amplicons_fasta);
+
+    if (!fasta.is_open()){
+        std::cerr << "Error opening the FASTA file." << std::endl;
+        return 1;
+    }
+
+    std::cout << "Writing the amplicons to a FASTA file..." << std::endl;
+
+    int ret = write_amplicons(fasta, amplicons, vec_reps);
+
+    // close the FASTA file
+    fasta.close();
+
+    return ret;
+}
+
+
+/**
+ * @brief Get the file name of an output partition by inserting its key before the file extension.
+ * 
+ * @param amplicons_fasta The name of the FASTA file, e.g. "amplicons.fasta".
+ * @param key The key of the partition, e.g. "pool_1".
+ * @return std::string The name of the partition file, e.g. "amplicons.pool_1.fasta".
+ */
+static std::string partition_file_name(const std::string &amplicons_fasta, const std::string &key){
+
+    size_t slash = amplicons_fasta.find_last_of('/');
+    size_t dot = amplicons_fasta.find_last_of('.');
+
+    // no extension in the file name (the dot may belong to a directory)
+    if (dot == std::string::npos || (slash != std::string::npos && dot < slash)){
+        return amplicons_fasta + "." + key;
+    }
+
+    return amplicons_fasta.substr(0, dot) + "." + key + amplicons_fasta.substr(dot);
+}
+
+
+/**
+ * @brief Turn a partition key into a safe part of a file name.
+ * 
+ * @details Every character except letters, digits, '.', '-' and '_' (e.g. the '/' or '|' of a contig name) is replaced by '_'.
+ * @param key The partition key.
+ * @return std::string The sanitised key.
+ */
+static std::string sanitize_file_key(const std::string &key){
+
+    std::string safe = key;
+    for (auto &c : safe){
+        if (!isalnum((unsigned char) c) && c != '.' && c != '-' && c != '_'){
+            c = '_';
+        }
+    }
+    if (safe.empty() || safe == "." || safe == ".."){
+        safe = "_" + safe;
+    }
+
+    return safe;
+}
+
+
+/**
+ * @brief Write the amplicons to one FASTA file per partition, with one writer thread per partition.
+ * 
+ * @details The amplicons keep the headers of the unpartitioned output. The partitions are
+ *          - pool   : one file per primer pool (fifth BED column)
+ *          - contig : one file per chromosome
+ *          - N      : one file per N consecutive amplicon templates
+ * @param amplicons_fasta The name of the FASTA file, the partition key is inserted before its extension.
+ * @param amplicons A vector of strings containing the amplicons.
+ * @param vec_reps A vector of integers containing the number of replications for each amplicon.
+ * @param vec_primers A vector of integers containing the primer pair index of each amplicon.
+ * @param primers The vector of Primer objects.
+ * @param partition The partition mode ("pool", "contig" or a positive integer N).
+ * @param n_threads The maximum number of partitions written in parallel.
+ * @return int 0 if the function was executed correctly, 1 otherwise.
+ */
+static int write_partitioned_amplicons(const char*                    amplicons_fasta,
+                                       const std::vector<std::string> &amplicons,
+                                       const std::vector<int>         &vec_reps,
+                                       const std::vector<int>         &vec_primers,
+                                       const std::vector<Primer>      &primers,
+                                       const std::string              &partition,
+                                       const int                      n_threads = 1){
+
+    int n_inserts = vec_reps.size();
+    int chunk_size = 0;
+
+    if (partition != "pool" && partition != "contig"){
+        chunk_size = atoi(partition.c_str());
+        if (chunk_size <= 0){
+            std::cerr << "Error: the partition must be pool, contig or a positive integer." << std::endl;
+            return 1;
+        }
+    }
+
+    std::cout << "Writing the amplicons to partitioned FASTA files..." << std::endl;
+
+    // assign every insert to a partition, partitions are numbered in order of their first insert
+    std::vector<std::string> keys;          // the sanitised keys of the file names, unique per partition
+    std::unordered_map<std::string, int> file_keys;
+    std::vector<std::vector<int>> partitions;
+    std::unordered_map<std::string, int> partition_index;
+
+    // index of the first amplicon of every insert
+    std::vector<int> first_amplicon(n_inserts, 0);
+
+    for (int idx_insert = 0; idx_insert < n_inserts; ++idx_insert){
+
+        if (idx_insert > 0){
+            first_amplicon[idx_insert] = first_amplicon[idx_insert - 1] + vec_reps[idx_insert - 1];
+        }
+
+        const Primer &primer = primers[vec_primers[idx_insert]];
+        std::string key;
+        if (partition == "pool"){
+            key = "pool_" + (primer.pool.empty() ? std::string("NA") : primer.pool);
+        } else if (partition == "contig"){
+            key = primer.chr;
+        } else {
+            key = "part_" + std::to_string(idx_insert / chunk_size);
+        }
+
+        auto it = partition_index.find(key);
+        if (it == partition_index.end()){
+            it = partition_index.insert(std::make_pair(key, (int) keys.size())).first;
+            // keys that are only distinct before sanitising get the partition number as a suffix
+            std::string file_key = sanitize_file_key(key);
+            while (file_keys.count(file_key) > 0){
+                file_key += "_" + std::to_string(keys.size());
+            }
+            file_keys[file_key] = keys.size();
+            keys.push_back(file_key);
+            partitions.push_back(std::vector<int>());
+        }
+        partitions[it->second].push_back(idx_insert);
     }
 
-    return 0;
+    // every worker writes the next unwritten partition with its own file stream
+    int n_partitions = partitions.size();
+    int next_partition = 0;
+    int status = 0;
+    std::mutex mutex;
+
+    auto partition_writer = [&](){
+        while (true){
+            int p;
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                if (next_partition >= n_partitions || status != 0){
+                    break;
+                }
+                p = next_partition++;
+            }
+
+            std::string file_name = partition_file_name(amplicons_fasta, keys[p]);
+            std::ofstream fasta(file_name);
+            if (!fasta.is_open()){
+                std::lock_guard<std::mutex> lock(mutex);
+                std::cerr << "Error opening the FASTA file \'" << file_name << "\'." << std::endl;
+                status = 1;
+                break;
+            }
+
+            for (int idx_insert : partitions[p]){
+                for (int idx_amplicon = first_amplicon[idx_insert]; idx_amplicon < first_amplicon[idx_insert] + vec_reps[idx_insert]; ++idx_amplicon){
+                    fasta << ">amplicon_" << idx_insert << "_" << idx_amplicon << '\n';
+                    fasta << amplicons[idx_amplicon] << '\n';
+                }
+            }
+
+            fasta.close();
+            if (fasta.fail()){
+                std::lock_guard<std::mutex> lock(mutex);
+                std::cerr << "Error writing the FASTA file \'" << file_name << "\'." << std::endl;
+                status = 1;
+                break;
+            }
+        }
+    };
+
+    std::vector<std::thread> writers;
+    for (int t = 1; t < std::min(n_threads, n_partitions); t++){
+        writers.push_back(std::thread(partition_writer));
+    }
+    partition_writer();
+    for (auto &writer : writers){
+        writer.join();
+    }
+
+    return status;
 }
 
 
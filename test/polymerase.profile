@@ -0,0 +1,9 @@
+# a context dependent polymerase for the CI runs
+rate 0.002
+indel 0.05 0.15
+position 0 0.01
+position 1 0.005
+homopolymer 4 0.005
+homopolymer 8 0.02
+substitution A 0 1 4 1
+substitution C 1 0 1 4
@@ -0,0 +1,357 @@
+// Purpose: Generate reproducible synthetic references and primer schemes for scaling tests of amplisim.
+
+#include <string>
+#include <vector>
+#include <random>
+#include <algorithm>
+#include <iostream>
+#include <fstream>
+#include <cassert>
+#include <cstdlib>
+#include <cstdint>
+#include <utility>
+#include <argp.h>
+
+
+
+const char *argp_program_version = VERSION; // INFO for the argument parser - defined in Makefile
+const char *argp_program_bug_address = "https://github.com/rki-mf1/amplisim/issues"; // INFO for the argument parser
+
+static char doc[] = "amplisim-synth -- a program to generate synthetic references and tiling primer schemes for amplisim";
+static char args_doc[] = "PREFIX";
+
+static struct argp_option options[] = {
+    {"seed",            's', "INT"  , 0, "Set a random seed"},
+    {"contigs",         'c', "INT"  , 0, "Set the number of contigs"},
+    {"length",          'l', "SIZE" , 0, "Set the mean contig length, suffixes k/M/G are allowed"},
+    {"jitter",          'j', "FLOAT", 0, "Set the relative variation of the contig lengths [0,1)"},
+    {"gc",              'g', "FLOAT", 0, "Set the GC content [0,1]"},
+    {"n-runs",          'r', "INT"  , 0, "Set the number of N runs per contig"},
+    {"n-length",        'R', "INT"  , 0, "Set the length of a N run"},
+    {"amplicon-length", 'a', "INT"  , 0, "Set the amplicon length (including primers)"},
+    {"overlap",         'v', "INT"  , 0, "Set the overlap of neighbouring amplicons"},
+    {"primer-length",   'p', "INT"  , 0, "Set the primer length"},
+    {"pools",           'P', "INT"  , 0, "Set the number of primer pools (amplicons alternate between pools)"},
+    {"max-amplicons",   'A', "INT"  , 0, "Set the maximum number of amplicons over all contigs"},
+    {0}
+};
+
+struct arguments {
+    char *prefix;
+    long seed;
+    int contigs;
+    int64_t length;
+    double jitter;
+    double gc;
+    int n_runs;
+    int n_length;
+    int amplicon_length;
+    int overlap;
+    int primer_length;
+    int pools;
+    int max_amplicons;
+};
+
+
+/**
+ * @brief Parse a size with an optional k/M/G suffix.
+ *
+ * @param arg The size as a string, e.g. "30k" or "3G".
+ * @return int64_t The size in bases.
+ */
+static int64_t parse_size(const char *arg){
+    char *end;
+    double size = strtod(arg, &end);
+    switch (*end){
+        case 'k': case 'K': size *= 1e3; break;
+        case 'm': case 'M': size *= 1e6; break;
+        case 'g': case 'G': size *= 1e9; break;
+        default: break;
+    }
+    return (int64_t) size;
+}
+
+static error_t parse_opt(int key, char *arg, struct argp_state *state){
+    struct arguments *arguments = (struct arguments *)state->input;
+
+    switch (key){
+        case 's':
+            arguments->seed = atol(arg);
+            break;
+        case 'c':
+            arguments->contigs = atoi(arg);
+            assert(arguments->contigs > 0);
+            break;
+        case 'l':
+            arguments->length = parse_size(arg);
+            assert(arguments->length > 0);
+            break;
+        case 'j':
+            arguments->jitter = atof(arg);
+            assert(arguments->jitter >= 0);
+            assert(arguments->jitter < 1);
+            break;
+        case 'g':
+            arguments->gc = atof(arg);
+            assert(arguments->gc >= 0);
+            assert(arguments->gc <= 1);
+            break;
+        case 'r':
+            arguments->n_runs = atoi(arg);
+            assert(arguments->n_runs >= 0);
+            break;
+        case 'R':
+            arguments->n_length = atoi(arg);
+            assert(arguments->n_length > 0);
+            break;
+        case 'a':
+            arguments->amplicon_length = atoi(arg);
+            break;
+        case 'v':
+            arguments->overlap = atoi(arg);
+            assert(arguments->overlap >= 0);
+            break;
+        case 'p':
+            arguments->primer_length = atoi(arg);
+            assert(arguments->primer_length > 0);
+            break;
+        case 'P':
+            arguments->pools = atoi(arg);
+            assert(arguments->pools > 0);
+            break;
+        case 'A':
+            arguments->max_amplicons = atoi(arg);
+            assert(arguments->max_amplicons > 0);
+            break;
+        case ARGP_KEY_ARG:
+            if (state->arg_num >= 1){
+                argp_usage(state);
+            }
+            arguments->prefix = arg;
+            break;
+        case ARGP_KEY_END:
+            if (state->arg_num < 1){
+                argp_usage(state);
+            }
+            break;
+        default:
+            return ARGP_ERR_UNKNOWN;
+    }
+    return 0;
+}
+
+static struct argp argp = {options, parse_opt, args_doc, doc};
+
+
+/**
+ * @brief Draw a uniform double in [0,1) from the 53 upper bits of a 64-bit Mersenne Twister.
+ *
+ * @details std::uniform_real_distribution is implementation defined, the raw engine output is not.
+ *          Using the engine directly keeps the generated data identical across platforms.
+ */
+static double uniform(std::mt19937_64 &gen){
+    return (gen() >> 11) * (1.0 / 9007199254740992.0);
+}
+
+
+/**
+ * @brief Write a random contig in FASTA format and return its FAI record.
+ *
+ * @param fasta The FASTA output stream.
+ * @param name The name of the contig.
+ * @param length The length of the contig.
+ * @param n_runs The sorted start positions of the N runs of the contig.
+ * @param arguments The command line arguments.
+ * @param gen The random number generator.
+ * @return std::string The line of the contig in the FAI index.
+ */
+static std::string write_contig(std::ofstream &fasta, const std::string &name, int64_t length, const std::vector<int64_t> &n_runs, const arguments &arguments, std::mt19937_64 &gen){
+
+    const int line_width = 60;
+    int64_t offset = (int64_t) fasta.tellp() + name.size() + 2;
+
+    fasta << ">" << name << "\n";
+
+    // every base consumes 16 bits: bit 0 picks the base within its class, bits 1-15 decide between GC and AT
+    const uint32_t gc_threshold = (uint32_t) (arguments.gc * 32768);
+    uint64_t bits = 0;
+    int n_bits = 0;
+
+    std::string buffer;
+    buffer.reserve(1 << 20);
+
+    size_t next_run = 0;
+    int64_t run_end = -1;
+
+    for (int64_t pos = 0; pos < length; pos++){
+
+        if (n_bits == 0){
+            bits = gen();
+            n_bits = 4;
+        }
+        uint32_t chunk = bits & 0xFFFF;
+        bits >>= 16;
+        n_bits--;
+
+        while (next_run < n_runs.size() && n_runs[next_run] <= pos){
+            run_end = std::max(run_end, n_runs[next_run] + arguments.n_length);
+            next_run++;
+        }
+
+        char base;
+        if (pos < run_end){
+            base = 'N';
+        } else if ((chunk >> 1) < gc_threshold){
+            base = (chunk & 1) ? 'G' : 'C';
+        } else {
+            base = (chunk & 1) ? 'T' : 'A';
+        }
+
+        buffer += base;
+        if ((pos + 1) % line_width == 0 || pos + 1 == length){
+            buffer += '\n';
+        }
+
+        if (buffer.size() >= (1 << 20) - line_width){
+            fasta << buffer;
+            buffer.clear();
+        }
+    }
+    fasta << buffer;
+
+    return name + "\t" + std::to_string(length) + "\t" + std::to_string(offset) + "\t" + std::to_string(line_width) + "\t" + std::to_string(line_width + 1) + "\n";
+}
+
+
+/**
+ * @brief Write the tiling primer scheme of a contig in BED format.
+ *
+ * @details Primers that overlap with a N run are skipped together with their amplicon.
+ * @param bed The BED output stream.
+ * @param name The name of the contig.
+ * @param length The length of the contig.
+ * @param n_runs The sorted start positions of the N runs of the contig.
+ * @param arguments The command line arguments.
+ * @param n_amplicons The number of amplicons written so far (updated).
+ */
+static void write_scheme(std::ofstream &bed, const std::string &name, int64_t length, const std::vector<int64_t> &n_runs, const arguments &arguments, int &n_amplicons){
+
+    const int64_t step = arguments.amplicon_length - arguments.overlap;
+
+    // check whether a range [start, end) overlaps with any N run
+    // all runs have the same length, hence only the last run starting before end can reach into the range
+    auto overlaps_n_run = [&](int64_t start, int64_t end){
+        auto it = std::lower_bound(n_runs.begin(), n_runs.end(), end);
+        return it != n_runs.begin() && *(it - 1) + arguments.n_length > start;
+    };
+
+    int idx = 0;
+    for (int64_t start = arguments.primer_length; start + arguments.amplicon_length + arguments.primer_length <= length; start += step){
+
+        if (n_amplicons >= arguments.max_amplicons){
+            break;
+        }
+
+        int64_t left_end = start + arguments.primer_length;
+        int64_t right_start = start + arguments.amplicon_length - arguments.primer_length;
+        int64_t right_end = start + arguments.amplicon_length;
+        idx++;
+
+        if (overlaps_n_run(start, left_end) || overlaps_n_run(right_start, right_end)){
+            continue;
+        }
+
+        int pool = (idx - 1) % arguments.pools + 1;
+        bed << name << "\t" << start << "\t" << left_end << "\t" << name << "_" << idx << "_LEFT\t" << pool << "\t+\n";
+        bed << name << "\t" << right_start << "\t" << right_end << "\t" << name << "_" << idx << "_RIGHT\t" << pool << "\t-\n";
+        n_amplicons++;
+    }
+}
+
+
+int main(int argc, char *argv[]){
+
+    struct arguments arguments;
+    // defaults for CLI parameters
+    arguments.prefix = NULL;
+    arguments.seed = 1;
+    arguments.contigs = 1;
+    arguments.length = 30000;
+    arguments.jitter = 0.0;
+    arguments.gc = 0.4;
+    arguments.n_runs = 0;
+    arguments.n_length = 100;
+    arguments.amplicon_length = 400;
+    arguments.overlap = 50;
+    arguments.primer_length = 22;
+    arguments.pools = 2;
+    arguments.max_amplicons = 100000;
+
+    argp_parse(&argp, argc, argv, 0, 0, &arguments);
+
+    if (arguments.amplicon_length <= 2 * arguments.primer_length || arguments.overlap >= arguments.amplicon_length){
+        std::cerr << "Error: the amplicon length must exceed both primers and the overlap." << std::endl;
+        return 1;
+    }
+
+    std::string prefix = arguments.prefix;
+    std::ofstream fasta(prefix + ".fasta", std::ios::binary);
+    std::ofstream fai(prefix + ".fasta.fai");
+    std::ofstream bed(prefix + ".primer.bed");
+
+    if (!fasta.is_open() || !fai.is_open() || !bed.is_open()){
+        std::cerr << "Error opening the output files." << std::endl;
+        return 1;
+    }
+
+    std::mt19937_64 gen(arguments.seed);
+    int n_amplicons = 0;
+    int64_t total_length = 0;
+
+    for (int c = 0; c < arguments.contigs; c++){
+
+        std::string name = "synth_" + std::to_string(c + 1);
+
+        // contig length within [length * (1 - jitter), length * (1 + jitter)]
+        int64_t length = (int64_t) (arguments.length * (1.0 + arguments.jitter * (2.0 * uniform(gen) - 1.0)));
+        length = std::max(length, (int64_t) 1);
+
+        // N runs at uniform positions of the contig
+        std::vector<int64_t> n_runs;
+        for (int r = 0; r < arguments.n_runs; r++){
+            n_runs.push_back((int64_t) (uniform(gen) * length));
+        }
+        std::sort(n_runs.begin(), n_runs.end());
+
+        fai << write_contig(fasta, name, length, n_runs, arguments, gen);
+        write_scheme(bed, name, length, n_runs, arguments, n_amplicons);
+        total_length += length;
+
+        // stop early if a file cannot be written, e.g. on a full disk
+        if (fasta.fail() || fai.fail() || bed.fail()){
+            break;
+        }
+    }
+
+    fasta.close();
+    fai.close();
+    bed.close();
+
+    const std::pair<std::ofstream *, std::string> files[] = {{&fasta, prefix + ".fasta"}, {&fai, prefix + ".fasta.fai"}, {&bed, prefix + ".primer.bed"}};
+    int ret = 0;
+    for (auto &file : files){
+        if (file.first->fail()){
+            std::cerr << "Error writing the output file \'" << file.second << "\'." << std::endl;
+            ret = 1;
+        }
+    }
+    if (ret != 0){
+        return 1;
+    }
+
+    std::cout << "Contigs   : " << arguments.contigs << std::endl;
+    std::cout << "Bases     : " << total_length << std::endl;
+    std::cout << "Amplicons : " << n_amplicons << std::endl;
+
+    return 0;
+}